@@ -0,0 +1,216 @@
+#pragma once
+#include "lazy_map.h"
+#include "structured_matrix.h"
+#include <cmath>
+#include <vector>
+
+/**
+ * @brief      Exchanges rows i and p of a
+ */
+template <typename R1> void _swap_rows(R1 &a, const sz_t &i, const sz_t &p) {
+  if (i == p) {
+    return;
+  }
+  for (sz_t j = 0; j < a.shape().second; j++) {
+    std::swap(a(i, j), a(p, j));
+  }
+}
+
+/**
+ * @brief      Unblocked LU with partial pivoting of the columns [k0, k1) of
+ *             a, rows k0 and below. Pivot rows are exchanged over the whole
+ *             width of a, which also applies them to the factored columns on
+ *             the left and to the not yet updated columns on the right.
+ */
+template <typename T>
+void _lu_panel(lazy_map<T> &a, std::vector<sz_t> &piv, const sz_t &k0,
+               const sz_t &k1, sz_t &info) {
+  const sz_t n = a.shape().first;
+  for (sz_t j = k0; j < k1; j++) {
+    sz_t p = j;
+    for (sz_t i = j + 1; i < n; i++) {
+      if (std::abs(a(i, j)) > std::abs(a(p, j))) {
+        p = i;
+      }
+    }
+    piv[j] = p;
+    _swap_rows(a, j, p);
+    const T d = a(j, j);
+    // a zero pivot leaves its column as it is, the matrix being singular
+    if (d == T()) {
+      info = std::min(info, j);
+      continue;
+    }
+#pragma omp parallel for schedule(static) if (n - j > 4 * _tile_size)
+    for (sz_t i = j + 1; i < n; i++) {
+      const T l = a(i, j) /= d;
+      for (sz_t k = j + 1; k < k1; k++) {
+        a(i, k) -= l * a(j, k);
+      }
+    }
+  }
+}
+
+/**
+ * @brief      Factors a = P % L % U in place with a blocked, right-looking LU
+ *             with partial pivoting.
+ *
+ *             Panels of _tile_size columns are factored one after another.
+ *             After each panel the block row on its right is solved against
+ *             L11 and the trailing matrix is updated with A22 -= L21 % U12
+ *             through _gemm, whose row tiles are split between threads, so
+ *             nearly all of the work runs at the speed of a matrix product.
+ *
+ *             On return the strict lower triangle of a holds L, whose
+ *             diagonal is one, and the upper triangle holds U. A zero pivot
+ *             does not stop the factorization, but U is then singular and
+ *             lu_solve() must not be used.
+ *
+ * @param      a     The n x m matrix to factor
+ * @param      piv   Set to the pivots: row i was exchanged with row piv[i],
+ *                   in order of increasing i
+ *
+ * @return     The index of the first zero pivot, min(n, m) if there is none
+ */
+template <typename T, typename ploy>
+sz_t lu(lazy_matrix<T, ploy> &a, std::vector<sz_t> &piv) {
+  lazy_map<T> m(a);
+  const sz_t n = a.shape().first;
+  const sz_t r = std::min(n, a.shape().second);
+  const sz_t c = a.shape().second;
+  sz_t info = r;
+  piv.assign(r, 0);
+  for (sz_t k = 0; k < r; k += _tile_size) {
+    const sz_t kb = std::min(_tile_size, r - k);
+    _lu_panel(m, piv, k, k + kb, info);
+    if (k + kb == c) {
+      continue;
+    }
+    const auto l11 = m.block(k, k, kb, kb);
+    auto u12 = m.block(k, k + kb, kb, c - k - kb);
+    trsolve(l11, u12, triangle::lower, true);
+    if (k + kb == n) {
+      continue;
+    }
+    const auto l21 = m.block(k + kb, k, n - k - kb, kb);
+    auto a22 = m.block(k + kb, k + kb, n - k - kb, c - k - kb);
+    _gemm(l21 * T(-1), u12, a22);
+  }
+  return info;
+}
+
+/**
+ * @brief      Solves a % x = b in place of b, given the factors and pivots
+ *             computed by lu() for a square, non-singular a
+ *
+ * @param[in]  f     The factored matrix
+ * @param[in]  piv   The pivots
+ * @param      b     The right hand sides, overwritten with the solutions
+ */
+template <typename T, typename ploy, typename R1>
+void lu_solve(const lazy_matrix<T, ploy> &f, const std::vector<sz_t> &piv,
+              R1 &b) {
+  assert(f.shape().first == f.shape().second && piv.size() == f.shape().first);
+  for (sz_t i = 0; i < piv.size(); i++) {
+    _swap_rows(b, i, piv[i]);
+  }
+  const lazy_map<const T> m(f);
+  trsolve(m, b, triangle::lower, true);
+  trsolve(m, b, triangle::upper);
+}
+
+/**
+ * @brief      Unblocked Cholesky of the diagonal block [k0, k1) of a, whose
+ *             earlier columns have already been subtracted
+ *
+ * @return     false if the block is not positive definite
+ */
+template <typename T>
+bool _cholesky_block(lazy_map<T> &a, const sz_t &k0, const sz_t &k1) {
+  for (sz_t j = k0; j < k1; j++) {
+    T d = a(j, j);
+    for (sz_t k = k0; k < j; k++) {
+      d -= a(j, k) * a(j, k);
+    }
+    if (!(d > T())) {
+      return false;
+    }
+    d = std::sqrt(d);
+    a(j, j) = d;
+    for (sz_t i = j + 1; i < k1; i++) {
+      T s = a(i, j);
+      for (sz_t k = k0; k < j; k++) {
+        s -= a(i, k) * a(j, k);
+      }
+      a(i, j) = s / d;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief      Factors a symmetric positive definite a = L % L^T in place
+ *             with a blocked, right-looking Cholesky.
+ *
+ *             Only the lower triangle of a is read. After each diagonal block
+ *             is factored, the column below it is solved against it and the
+ *             lower triangle of the trailing matrix is updated with
+ *             A22 -= L21 % L21^T through _gemm, one block column at a time,
+ *             the row tiles of each being split between threads.
+ *
+ *             On return the lower triangle of a holds L and the strict upper
+ *             triangle is zero.
+ *
+ * @param      a     The n x n matrix to factor
+ *
+ * @return     false if a is not positive definite, a then being left
+ *             partially factored
+ */
+template <typename T, typename ploy> bool cholesky(lazy_matrix<T, ploy> &a) {
+  assert(a.shape().first == a.shape().second);
+  lazy_map<T> m(a);
+  const sz_t n = a.shape().first;
+  for (sz_t k = 0; k < n; k += _tile_size) {
+    const sz_t kb = std::min(_tile_size, n - k);
+    if (!_cholesky_block(m, k, k + kb)) {
+      return false;
+    }
+    if (k + kb == n) {
+      continue;
+    }
+    // L21 = A21 % L11^-T, i.e. L11 % L21^T = A21^T
+    const sz_t rest = n - k - kb;
+    const auto l11 = m.block(k, k, kb, kb);
+    auto l21t = m.block(k + kb, k, rest, kb).transposed();
+    trsolve(l11, l21t, triangle::lower);
+    const auto l21 = l21t.transposed();
+    // only the block columns on and below the diagonal of A22 are updated
+    for (sz_t j = 0; j < rest; j += _tile_size) {
+      const sz_t jb = std::min(_tile_size, rest - j);
+      auto a22 = m.block(k + kb + j, k + kb + j, rest - j, jb);
+      _gemm(l21.block(j, 0, rest - j, kb) * T(-1),
+            l21t.block(0, j, kb, jb), a22);
+    }
+  }
+#pragma omp parallel for schedule(static)
+  for (sz_t i = 0; i < n; i++) {
+    for (sz_t j = i + 1; j < n; j++) {
+      m(i, j) = T();
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief      Solves a % x = b in place of b, given the factor L returned by
+ *             cholesky()
+ *
+ * @param[in]  f     The factored matrix
+ * @param      b     The right hand sides, overwritten with the solutions
+ */
+template <typename T, typename ploy, typename R1>
+void cholesky_solve(const lazy_matrix<T, ploy> &f, R1 &b) {
+  const lazy_map<const T> m(f);
+  trsolve(m, b, triangle::lower);
+  trsolve(m.transposed(), b, triangle::upper);
+}
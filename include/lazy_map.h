@@ -0,0 +1,226 @@
+#pragma once
+#include "lazy_matrix.h"
+#include <type_traits>
+
+/**
+ * @brief      Class for a matrix mapped onto memory owned by someone else.
+ *
+ *             No element is copied: the map reads and writes the buffer it
+ *             was given, which must outlive it. Element (i, j) lives at
+ *             data[i * stride_x + j * stride_y], so row major, column major,
+ *             padded and sliced buffers (e.g. NumPy arrays, whose strides
+ *             are given in bytes and must be divided by sizeof(T)) can all
+ *             be mapped. A map can be used as an operand of any expression
+ *             and as the destination of an assignment.
+ *
+ * @tparam     T     Data type of the matrix, const for read-only buffers
+ */
+template <typename T> class lazy_map : public expr_ops<lazy_map<T>> {
+private:
+  T *_array;
+  sz_t size_x;
+  sz_t size_y;
+  sz_t stride_x;
+  sz_t stride_y;
+
+  /**
+   * @brief      Calls f(i, j) for every element, walking the buffer in the
+   *             order it is laid out and splitting the outer loop between
+   *             threads
+   */
+  template <typename F> void _for_each(const F &f) const {
+    if (stride_y <= stride_x) {
+      policy::row_major::for_each(size_x, size_y, f);
+    } else {
+      policy::column_major::for_each(size_x, size_y, f);
+    }
+  }
+
+public:
+  using value_type = std::remove_const_t<T>;
+
+  /**
+   * @brief      Constructs the object.
+   *
+   * @param      data  The mapped buffer
+   * @param[in]  n     Number of rows in the matrix
+   * @param[in]  m     Number of columns in the matrix
+   * @param[in]  sx    Distance in elements between consecutive rows
+   * @param[in]  sy    Distance in elements between consecutive columns
+   */
+  lazy_map(T *data, const sz_t &n, const sz_t &m, const sz_t &sx,
+           const sz_t &sy)
+      : _array(data), size_x(n), size_y(m), stride_x(sx), stride_y(sy) {}
+
+  /**
+   * @brief      Constructs the object for a buffer laid out by a policy.
+   *
+   * @param      data  The mapped buffer
+   * @param[in]  n     Number of rows in the matrix
+   * @param[in]  m     Number of columns in the matrix
+   * @param[in]  ld    Leading dimension, 0 for a packed buffer
+   *
+   * @tparam     ploy  policy::row_major or policy::column_major
+   */
+  template <typename ploy,
+            typename = std::enable_if_t<std::is_class<ploy>::value>>
+  lazy_map(T *data, const sz_t &n, const sz_t &m, ploy,
+           const sz_t &ld = 0)
+      : _array(data), size_x(n), size_y(m),
+        stride_x(ploy::strides(ld ? ld : ploy::inner(n, m)).first),
+        stride_y(ploy::strides(ld ? ld : ploy::inner(n, m)).second) {}
+
+  /**
+   * @brief      Maps the storage of a lazy matrix
+   *
+   * @param      a     The matrix
+   */
+  template <typename ploy>
+  lazy_map(lazy_matrix<value_type, ploy> &a)
+      : lazy_map(a.data(), a.shape().first, a.shape().second, ploy(),
+                 a.leading_dim()) {}
+  template <typename ploy>
+  lazy_map(const lazy_matrix<value_type, ploy> &a)
+      : lazy_map(a.data(), a.shape().first, a.shape().second, ploy(),
+                 a.leading_dim()) {
+    static_assert(std::is_const<T>::value,
+                  "a const lazy_matrix needs a lazy_map<const T>");
+  }
+
+  lazy_map(const lazy_map &other) = default;
+
+  /**
+   * @brief      Gives the dimensions of the matrix
+   */
+  decltype(auto) shape() const { return std::make_pair(size_x, size_y); }
+  /**
+   * @brief      Gives the distance in elements between consecutive rows and
+   *             between consecutive columns
+   */
+  decltype(auto) strides() const { return std::make_pair(stride_x, stride_y); }
+  /**
+   * @brief      Gives the mapped buffer
+   */
+  T *data() const { return _array; }
+
+  /**
+   * @brief      Gives the r x c block whose top left element is (i, j), as a
+   *             map over the same buffer
+   */
+  lazy_map block(const sz_t &i, const sz_t &j, const sz_t &r,
+                 const sz_t &c) const {
+    assert(i + r <= size_x && j + c <= size_y);
+    return lazy_map(_array + i * stride_x + j * stride_y, r, c, stride_x,
+                    stride_y);
+  }
+  /**
+   * @brief      Gives the transpose, as a map over the same buffer
+   */
+  lazy_map transposed() const {
+    return lazy_map(_array, size_y, size_x, stride_y, stride_x);
+  }
+
+  /**
+   * Operator () Overloading for getting the (i,j)th element
+   */
+  inline const value_type operator()(const sz_t i, const sz_t j) const {
+    return _array[i * stride_x + j * stride_y];
+  }
+  inline T &operator()(const sz_t i, const sz_t j) {
+    return _array[i * stride_x + j * stride_y];
+  }
+
+  /**
+   * @brief      Oveloading operator << to use std:: cout
+   */
+  friend std::ostream &operator<<(std::ostream &out, const lazy_map &other) {
+    for (sz_t i = 0; i < other.size_x; i++) {
+      for (sz_t j = 0; j < other.size_y; j++) {
+        out << other(i, j) << ' ';
+      }
+      out << std::endl;
+    }
+    return out;
+  }
+
+  /**
+   * @brief      Overloading operator = for writing a matrix or an expression
+   *             into the mapped buffer
+   *
+   *             Element-wise expressions are written straight into the buffer,
+   *             each element being computed and stored in one step, so they
+   *             may read the map itself but not another view overlapping it
+   *             at a different offset. Expressions containing a matrix
+   *             product read whole rows and columns and are evaluated into a
+   *             temporary first.
+   *
+   * @param[in]  other  reference to the matrix or expression which is to be
+   *                    assigned
+   *
+   * @tparam     R1     expression type or matrix type
+   */
+  template <typename R1> lazy_map &operator=(const R1 &other) {
+    assert(shape() == other.shape());
+    if constexpr (_has_product<R1>::value) {
+      const lazy_matrix<value_type> temp(other);
+      _for_each(
+          [&](const sz_t &i, const sz_t &j) { (*this)(i, j) = temp(i, j); });
+    } else {
+      _for_each(
+          [&](const sz_t &i, const sz_t &j) { (*this)(i, j) = other(i, j); });
+    }
+    return *this;
+  }
+  lazy_map &operator=(const lazy_map &other) {
+    return operator=<lazy_map>(other);
+  }
+
+  /**
+   * @brief      Overloading operator == for a comparing equality with other
+   *             matrix
+   */
+  template <typename R1> bool operator==(const R1 &other) const {
+    if (shape() != other.shape()) {
+      return false;
+    }
+    for (sz_t i = 0; i < size_x; i++) {
+      for (sz_t j = 0; j < size_y; j++) {
+        if ((*this)(i, j) != other(i, j)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief      assignment after adding
+   */
+  template <typename R1> void operator+=(const R1 &other) {
+    *this = *this + other;
+  }
+  /**
+   * @brief      assignment after subtracting
+   */
+  template <typename R1> void operator-=(const R1 &other) {
+    *this = *this - other;
+  }
+  /**
+   * @brief      assignment after element-wise division
+   */
+  template <typename R1> void operator/=(const R1 &other) {
+    *this = *this / other;
+  }
+  /**
+   * @brief      assignment after element-wise multiplication
+   */
+  template <typename R1> void operator*=(const R1 &other) {
+    *this = *this * other;
+  }
+  /**
+   * @brief      assignment after standard matrix multiplication
+   */
+  template <typename R1> void operator%=(const R1 &other) {
+    *this = *this % other;
+  }
+};
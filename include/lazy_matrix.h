@@ -1,7 +1,14 @@
 #pragma once
+#include "numa.h"
+#include <algorithm>
 #include <cassert>
+#include <functional>
 #include <iostream>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
 #include <typeinfo>
+#include <utility>
 #include <vector>
 
 using sz_t = std::size_t;
@@ -9,6 +16,35 @@ template <typename T> using TDVec = std::vector<std::vector<T>>;
 template <typename T>
 using List = std::initializer_list<std::initializer_list<T>>;
 
+/**
+ * @brief      Side of the square tiles in which fused assignments and
+ *             products walk the result
+ */
+constexpr sz_t _tile_size = 64;
+
+/**
+ * @brief      Gives the leading dimension for n contiguously stored elements.
+ *
+ *             Rows are padded to whole 64 byte cache lines, so every row
+ *             starts on its own line, and by one more line when the stride
+ *             would be a multiple of 512 bytes, which maps consecutive rows
+ *             onto the same few cache sets. Rows narrower than four lines are
+ *             kept packed, as padding them would cost more than it saves.
+ *
+ * @tparam     T     Data type of the elements
+ */
+template <typename T> sz_t _leading_dim(const sz_t &n) {
+  constexpr sz_t line = 64 % sizeof(T) == 0 ? 64 / sizeof(T) : 1;
+  if (line == 1 || n < 4 * line) {
+    return n;
+  }
+  sz_t ld = (n + line - 1) / line * line;
+  if ((ld * sizeof(T)) % 512 == 0) {
+    ld += line;
+  }
+  return ld;
+}
+
 namespace policy {
 /**
  * @brief      policy that take row as first priority
@@ -17,11 +53,42 @@ class row_major {
 public:
   template <typename R1>
   decltype(auto) operator()(const sz_t &i, const sz_t &j, const R1 &a) const {
-    return a._array[i * a.size_y + j];
+    return a._array[i * a.ld + j];
   }
   template <typename R1>
   decltype(auto) operator()(const sz_t &i, const sz_t &j, R1 &a) {
-    return a._array[i * a.size_y + j];
+    return a._array[i * a.ld + j];
+  }
+  /**
+   * @brief      Gives the number of contiguously stored elements of an n x m
+   *             matrix
+   */
+  static sz_t inner(const sz_t &, const sz_t &m) { return m; }
+  /**
+   * @brief      Gives the number of rows of storage of an n x m matrix
+   */
+  static sz_t outer(const sz_t &n, const sz_t &) { return n; }
+  /**
+   * @brief      Gives the distance between consecutive elements of a column
+   *             and of a row for leading dimension ld
+   */
+  static std::pair<sz_t, sz_t> strides(const sz_t &ld) {
+    return std::make_pair(ld, sz_t(1));
+  }
+  /**
+   * @brief      Calls f(i, j) for every element in storage order, the rows
+   *             being split statically between threads and the inner loop,
+   *             whose iterations are independent, being vectorized
+   */
+  template <typename F>
+  static void for_each(const sz_t &n, const sz_t &m, const F &f) {
+#pragma omp parallel for schedule(static)
+    for (sz_t i = 0; i < n; i++) {
+#pragma omp simd
+      for (sz_t j = 0; j < m; j++) {
+        f(i, j);
+      }
+    }
   }
 };
 
@@ -32,11 +99,42 @@ class column_major {
 public:
   template <typename R1>
   decltype(auto) operator()(const sz_t &i, const sz_t &j, const R1 &a) const {
-    return a._array[j * a.size_x + i];
+    return a._array[j * a.ld + i];
   }
   template <typename R1>
   decltype(auto) operator()(const sz_t &i, const sz_t &j, R1 &a) {
-    return a._array[j * a.size_x + i];
+    return a._array[j * a.ld + i];
+  }
+  /**
+   * @brief      Gives the number of contiguously stored elements of an n x m
+   *             matrix
+   */
+  static sz_t inner(const sz_t &n, const sz_t &) { return n; }
+  /**
+   * @brief      Gives the number of columns of storage of an n x m matrix
+   */
+  static sz_t outer(const sz_t &, const sz_t &m) { return m; }
+  /**
+   * @brief      Gives the distance between consecutive elements of a column
+   *             and of a row for leading dimension ld
+   */
+  static std::pair<sz_t, sz_t> strides(const sz_t &ld) {
+    return std::make_pair(sz_t(1), ld);
+  }
+  /**
+   * @brief      Calls f(i, j) for every element in storage order, the columns
+   *             being split statically between threads and the inner loop,
+   *             whose iterations are independent, being vectorized
+   */
+  template <typename F>
+  static void for_each(const sz_t &n, const sz_t &m, const F &f) {
+#pragma omp parallel for schedule(static)
+    for (sz_t j = 0; j < m; j++) {
+#pragma omp simd
+      for (sz_t i = 0; i < n; i++) {
+        f(i, j);
+      }
+    }
   }
 };
 }; // namespace policy
@@ -107,45 +205,103 @@ struct _smul {
   }
 };
 
+/**
+ * @brief      Functor applying f between every element and a scalar held by
+ *             value, as s f x when left is true and as x f s otherwise
+ */
+template <typename S, typename F, bool left> struct _scalar_op {
+  S s;
+  F f;
+  template <typename R1, typename R2>
+  decltype(auto) operator()(const R1 &op1, const R2 &, const sz_t &i,
+                            const sz_t &j) const {
+    if constexpr (left) {
+      return f(s, op1(i, j));
+    } else {
+      return f(op1(i, j), s);
+    }
+  }
+};
+
+/**
+ * @brief      Tells whether a type can be used as a matrix operand, i.e.
+ *             has a shape()
+ */
+template <typename R, typename = void> struct _is_matrix : std::false_type {};
+template <typename R>
+struct _is_matrix<R, std::void_t<decltype(std::declval<const R &>().shape())>>
+    : std::true_type {};
+
+/**
+ * @brief      Tells whether a matrix type knows where its structural zeros
+ *             are, i.e. provides row_support(i) and col_support(j)
+ */
+template <typename R, typename = void> struct _has_support : std::false_type {};
+template <typename R>
+struct _has_support<
+    R, std::void_t<decltype(std::declval<const R &>().row_support(0))>>
+    : std::true_type {};
+
+/**
+ * @brief      Gives the range [first, second) of the columns of row i that
+ *             may be non-zero
+ */
+template <typename R>
+std::pair<sz_t, sz_t> _row_support(const R &a, const sz_t &i) {
+  if constexpr (_has_support<R>::value) {
+    return a.row_support(i);
+  } else {
+    return std::make_pair(sz_t(0), sz_t(a.shape().second));
+  }
+}
+
+/**
+ * @brief      Gives the range [first, second) of the rows of column j that
+ *             may be non-zero
+ */
+template <typename R>
+std::pair<sz_t, sz_t> _col_support(const R &a, const sz_t &j) {
+  if constexpr (_has_support<R>::value) {
+    return a.col_support(j);
+  } else {
+    return std::make_pair(sz_t(0), sz_t(a.shape().first));
+  }
+}
+
 /**
  * @brief      Functor for getting (i,j)th element of Standard Matrix-Matrix
- *             multiplication
+ *             multiplication, skipping the structural zeros of the operands
  */
 struct _std_mul {
   template <typename R1, typename R2>
   decltype(auto) operator()(const R1 &op1, const R2 &op2, const sz_t &i,
                             const sz_t &j) const {
-    return (_std_mul::operator()(op1, op2, op2.shape().first - 1, i, j));
-  }
-  template <typename R1, typename R2>
-  decltype(auto) operator()(const R1 &op1, const R2 &op2, const sz_t &k,
-                            const sz_t &i, const sz_t &j) const {
-    if (k == 0) {
-#pragma omp parallel single
-      {
-#pragma omp task
-        decltype(auto) temp1 = op1(i, k);
-#pragma omp task
-        decltype(auto) temp2 = op2(k, j);
-#pragma omp taskwait
-        return temp1 * temp2;
-      }
-    } else {
-#pragma omp parallel single
-      {
-#pragma omp task
-        decltype(auto) temp1 = op1(i, k);
-#pragma omp task
-        decltype(auto) temp2 = op2(k, j);
-#pragma omp task
-        decltype(auto) temp3 = _std_mul::operator()(op1, op2, k - 1, i, j);
-#pragma omp taskwait
-        return temp1 * temp2 + temp3;
-      }
+    const auto r = _row_support(op1, i);
+    const auto c = _col_support(op2, j);
+    const sz_t hi = std::min(r.second, c.second);
+    decltype(op1(i, 0) * op2(0, j)) sum{};
+    for (sz_t k = std::max(r.first, c.first); k < hi; k++) {
+      sum += op1(i, k) * op2(k, j);
     }
+    return sum;
   }
 };
 
+/**
+ * @brief      Gives the shape of the result of an element-wise operation
+ */
+template <typename R1, typename R2, typename Op>
+decltype(auto) _result_shape(const R1 &a, const R2 &, const Op &) {
+  return a.shape();
+}
+/**
+ * @brief      Gives the shape of the result of a matrix product
+ */
+template <typename R1, typename R2>
+decltype(auto) _result_shape(const R1 &a, const R2 &b, const _std_mul &) {
+  return std::make_pair(a.shape().first, b.shape().second);
+}
+
 /**
  * @brief      Class for expression.
  *
@@ -170,8 +326,8 @@ public:
    * @param[in]  f     Functor for Operator
    */
   expr(const R1 &a, const R2 &b, Op f)
-      : op1(a), op2(b), size_x(a.shape().first), size_y(b.shape().second),
-        op(f) {}
+      : op1(a), op2(b), size_x(_result_shape(a, b, f).first),
+        size_y(_result_shape(a, b, f).second), op(f) {}
   /**
    * @brief      Gives the dimensions of the resultant expression
    *
@@ -179,6 +335,18 @@ public:
    *             the second value is the number of columns
    */
   decltype(auto) shape() const { return std::make_pair(size_x, size_y); }
+  /**
+   * @brief      Gives the left operand
+   */
+  const R1 &lhs() const { return op1; }
+  /**
+   * @brief      Gives the right operand
+   */
+  const R2 &rhs() const { return op2; }
+  /**
+   * @brief      Gives the functor of the operation
+   */
+  const Op &functor() const { return op; }
 
   /**
    * @brief      Oveloading operator << to use std:: cout
@@ -198,7 +366,8 @@ public:
   /**
    * Operator + Overloading for Standard Matrix Addition
    */
-  template <typename F> decltype(auto) operator+(const F &other) {
+  template <typename F, typename = std::enable_if_t<_is_matrix<F>::value>>
+  decltype(auto) operator+(const F &other) {
     assert(shape() == other.shape());
     return expr<expr<R1, R2, Op>, F, _add>(*this, other, _add());
   }
@@ -206,7 +375,8 @@ public:
   /**
    * Operator - Overloading for Standard Matrix Subtraction
    */
-  template <typename F> decltype(auto) operator-(const F &other) {
+  template <typename F, typename = std::enable_if_t<_is_matrix<F>::value>>
+  decltype(auto) operator-(const F &other) {
     assert(shape() == other.shape());
     return expr<expr<R1, R2, Op>, F, _sub>(*this, other, _sub());
   }
@@ -215,7 +385,8 @@ public:
    * Operator / Overloading for Element-Wise Division
    */
 
-  template <typename F> decltype(auto) operator/(const F &other) {
+  template <typename F, typename = std::enable_if_t<_is_matrix<F>::value>>
+  decltype(auto) operator/(const F &other) {
     assert(shape() == other.shape());
     return expr<expr<R1, R2, Op>, F, _ediv>(*this, other, _ediv());
   }
@@ -223,7 +394,8 @@ public:
   /**
    * Operator * Overloading for Element-Wise Multiplication
    */
-  template <typename F> decltype(auto) operator*(const F &other) {
+  template <typename F, typename = std::enable_if_t<_is_matrix<F>::value>>
+  decltype(auto) operator*(const F &other) {
     assert(shape() == other.shape());
     return expr<expr<R1, R2, Op>, F, _emul>(*this, other, _emul());
   }
@@ -231,8 +403,9 @@ public:
   /**
    * Operator % Overloading for Standard Matrix Multiplication
    */
-  template <typename F> decltype(auto) operator%(const F &other) {
-    assert(size_y == other.shape().second);
+  template <typename F, typename = std::enable_if_t<_is_matrix<F>::value>>
+  decltype(auto) operator%(const F &other) {
+    assert(size_y == other.shape().first);
     return expr<expr<R1, R2, Op>, F, _std_mul>(*this, other, _std_mul());
   }
   /**
@@ -244,6 +417,143 @@ public:
   }
 };
 
+/**
+ * @brief      Tells whether an expression contains a matrix product, whose
+ *             elements read whole rows and columns of its operands, so that
+ *             it cannot be written element by element into one of them
+ */
+template <typename R> struct _has_product : std::false_type {};
+template <typename R1, typename R2, typename Op>
+struct _has_product<expr<R1, R2, Op>>
+    : std::integral_constant<bool, _has_product<R1>::value ||
+                                       _has_product<R2>::value> {};
+template <typename R1, typename R2>
+struct _has_product<expr<R1, R2, _std_mul>> : std::true_type {};
+
+/**
+ * @brief      Operators building expressions, shared by the matrix types
+ *             other than lazy_matrix
+ *
+ * @tparam     D     The derived matrix type
+ */
+template <typename D> class expr_ops {
+private:
+  const D &self() const { return static_cast<const D &>(*this); }
+
+public:
+  /**
+   * Operator + Overloading for Standard Matrix Addition
+   */
+  template <typename F, typename = std::enable_if_t<_is_matrix<F>::value>>
+  decltype(auto) operator+(const F &other) const {
+    assert(self().shape() == other.shape());
+    return expr<D, F, _add>(self(), other, _add());
+  }
+
+  /**
+   * Operator - Overloading for Standard Matrix Subtraction
+   */
+  template <typename F, typename = std::enable_if_t<_is_matrix<F>::value>>
+  decltype(auto) operator-(const F &other) const {
+    assert(self().shape() == other.shape());
+    return expr<D, F, _sub>(self(), other, _sub());
+  }
+
+  /**
+   * Operator / Overloading for Element-Wise Division
+   */
+  template <typename F, typename = std::enable_if_t<_is_matrix<F>::value>>
+  decltype(auto) operator/(const F &other) const {
+    assert(self().shape() == other.shape());
+    return expr<D, F, _ediv>(self(), other, _ediv());
+  }
+
+  /**
+   * Operator * Overloading for Element-Wise Multiplication
+   */
+  template <typename F, typename = std::enable_if_t<_is_matrix<F>::value>>
+  decltype(auto) operator*(const F &other) const {
+    assert(self().shape() == other.shape());
+    return expr<D, F, _emul>(self(), other, _emul());
+  }
+
+  /**
+   * Operator % Overloading for Standard Matrix Multiplication
+   */
+  template <typename F, typename = std::enable_if_t<_is_matrix<F>::value>>
+  decltype(auto) operator%(const F &other) const {
+    assert(self().shape().second == other.shape().first);
+    return expr<D, F, _std_mul>(self(), other, _std_mul());
+  }
+};
+
+/**
+ * @brief      Applies f between every element of a and the scalar s
+ */
+template <bool left, typename F, typename R1, typename S>
+decltype(auto) _with_scalar(const R1 &a, const S &s) {
+  return expr<R1, R1, _scalar_op<S, F, left>>(a, a,
+                                              _scalar_op<S, F, left>{s, F()});
+}
+
+template <typename R1, typename S>
+using _scalar_t = std::enable_if_t<_is_matrix<R1>::value &&
+                                       std::is_arithmetic<S>::value,
+                                   int>;
+
+/**
+ * Operator + Overloading for adding a scalar to every element
+ */
+template <typename R1, typename S, _scalar_t<R1, S> = 0>
+decltype(auto) operator+(const R1 &a, const S &s) {
+  return _with_scalar<false, std::plus<>>(a, s);
+}
+template <typename S, typename R1, _scalar_t<R1, S> = 0>
+decltype(auto) operator+(const S &s, const R1 &a) {
+  return _with_scalar<true, std::plus<>>(a, s);
+}
+
+/**
+ * Operator - Overloading for subtracting between a scalar and every element
+ */
+template <typename R1, typename S, _scalar_t<R1, S> = 0>
+decltype(auto) operator-(const R1 &a, const S &s) {
+  return _with_scalar<false, std::minus<>>(a, s);
+}
+template <typename S, typename R1, _scalar_t<R1, S> = 0>
+decltype(auto) operator-(const S &s, const R1 &a) {
+  return _with_scalar<true, std::minus<>>(a, s);
+}
+
+/**
+ * Operator * Overloading for multiplying every element with a scalar
+ */
+template <typename R1, typename S, _scalar_t<R1, S> = 0>
+decltype(auto) operator*(const R1 &a, const S &s) {
+  return _with_scalar<false, std::multiplies<>>(a, s);
+}
+template <typename S, typename R1, _scalar_t<R1, S> = 0>
+decltype(auto) operator*(const S &s, const R1 &a) {
+  return _with_scalar<true, std::multiplies<>>(a, s);
+}
+
+/**
+ * Operator / Overloading for dividing between a scalar and every element
+ */
+template <typename R1, typename S, _scalar_t<R1, S> = 0>
+decltype(auto) operator/(const R1 &a, const S &s) {
+  return _with_scalar<false, std::divides<>>(a, s);
+}
+template <typename S, typename R1, _scalar_t<R1, S> = 0>
+decltype(auto) operator/(const S &s, const R1 &a) {
+  return _with_scalar<true, std::divides<>>(a, s);
+}
+
+template <typename T, typename ploy = policy::row_major> class lazy_matrix;
+template <typename R1, typename R2, typename T, typename ploy>
+void _chain_product(const expr<R1, R2, _std_mul> &exp,
+                    lazy_matrix<T, ploy> &dest);
+
 /**
  * @brief      Class for lazy matrix.
  *
@@ -251,19 +561,33 @@ public:
  * @tparam     policy  User case assign how data will be accessed takes
  *             value policy:: row_major or policy::column_major
  */
-template <typename T, typename ploy = policy::row_major> class lazy_matrix {
+template <typename T, typename ploy> class lazy_matrix {
 private:
-  std::vector<T> _array;
   const sz_t size_x;
   const sz_t size_y;
+  // leading dimension: distance between the starts of consecutive rows
+  // (row_major) or columns (column_major)
+  const sz_t ld;
+  std::vector<T, numa::allocator<T>> _array;
   friend ploy;
   ploy pol;
 
+  /**
+   * @brief      Writes val to every element, the work being split between
+   *             threads by ploy::for_each as in every evaluation, so each page
+   *             is first touched by the thread that later evaluates it
+   */
+  void _first_touch(const T &val) {
+    ploy::for_each(size_x, size_y, [&](const sz_t &i, const sz_t &j) {
+      (*this)(i, j) = val;
+    });
+  }
+
 public:
   /**
    * @brief      Constructs the object.
    */
-  lazy_matrix() : size_x(0), size_y(0) {}
+  lazy_matrix() : size_x(0), size_y(0), ld(0) {}
 
   /**
    * @brief      Constructs the object.
@@ -272,7 +596,7 @@ public:
    * @param[in]  m     Number of columns in the matrix
    */
   lazy_matrix(const std::size_t &n, const std::size_t &m)
-      : _array(n * m), size_x(n), size_y(m) {}
+      : lazy_matrix(n, m, T()) {}
 
   /**
    * @brief      Constructs the object.
@@ -282,7 +606,31 @@ public:
    * @param[in]  val   The initial value
    */
   lazy_matrix(const std::size_t &n, const std::size_t &m, const T &val)
-      : _array(n * m, val), size_x(n), size_y(m) {}
+      : size_x(n), size_y(m), ld(_leading_dim<T>(ploy::inner(n, m))),
+        _array(ploy::outer(n, m) * ld) {
+    _first_touch(val);
+  }
+
+  /**
+   * @brief      Constructs the object with a NUMA placement policy.
+   *
+   * @param[in]  n     Number of rows in the matrix
+   * @param[in]  m     Number of columns in the matrix
+   * @param[in]  val   The initial value
+   * @param[in]  p     Placement of the pages across NUMA nodes
+   * @param[in]  node  Node used by numa::placement::bind
+   *
+   * @throws     std::runtime_error if the placement cannot be applied
+   */
+  lazy_matrix(const std::size_t &n, const std::size_t &m, const T &val,
+              const numa::placement p, const int node = 0)
+      : size_x(n), size_y(m), ld(_leading_dim<T>(ploy::inner(n, m))),
+        _array(ploy::outer(n, m) * ld) {
+    if (!numa::place(_array.data(), _array.size() * sizeof(T), p, node)) {
+      throw std::runtime_error("lazy_matrix: NUMA placement failed");
+    }
+    _first_touch(val);
+  }
 
   /**
    * @brief      Vector initialization
@@ -290,18 +638,10 @@ public:
    * @param[in]  vec   2D Vector input
    */
   lazy_matrix(const TDVec<T> &vec)
-      : size_x(vec.size()), size_y((*vec.begin()).size()) {
-    if (typeid(ploy) == typeid(policy::row_major)) {
-      for (auto &it : vec) {
-        _array.insert(_array.end(), it.begin(), it.end());
-      }
-    } else {
-      for (sz_t j = 0; j < size_y; j++) {
-        for (sz_t i = 0; i < size_x; i++) {
-          _array.push_back(vec[i][j]);
-        }
-      }
-    }
+      : lazy_matrix(vec.size(), (*vec.begin()).size()) {
+    ploy::for_each(size_x, size_y, [&](const sz_t &i, const sz_t &j) {
+      (*this)(i, j) = vec[i][j];
+    });
   }
 
   /**
@@ -310,18 +650,10 @@ public:
    * @param[in]  l     2D Initializer_list input
    */
   lazy_matrix(const List<T> &l)
-      : size_x(l.size()), size_y((*l.begin()).size()) {
-    if (typeid(ploy) == typeid(policy::row_major)) {
-      for (auto &it : l) {
-        _array.insert(_array.end(), it.begin(), it.end());
-      }
-    } else {
-      for (sz_t j = 0; j < size_y; j++) {
-        for (sz_t i = 0; i < size_x; i++) {
-          _array.push_back(*((*(l.begin() + i)).begin() + j));
-        }
-      }
-    }
+      : lazy_matrix(l.size(), (*l.begin()).size()) {
+    ploy::for_each(size_x, size_y, [&](const sz_t &i, const sz_t &j) {
+      (*this)(i, j) = *((*(l.begin() + i)).begin() + j);
+    });
   }
 
   /**
@@ -335,20 +667,27 @@ public:
    */
   template <typename R1, typename R2, typename R3>
   lazy_matrix(const expr<R1, R2, R3> &exp)
-      : size_x(exp.shape().first), size_y(exp.shape().second) {
-    if (typeid(ploy) == typeid(policy::row_major)) {
-      for (sz_t i = 0; i < size_x; i++) {
-        for (sz_t j = 0; j < size_y; j++) {
-          _array.push_back(exp(i, j));
-        }
-      }
-    } else {
-      for (sz_t j = 0; j < size_y; j++) {
-        for (sz_t i = 0; i < size_x; i++) {
-          _array.push_back(exp(i, j));
-        }
-      }
-    }
+      : size_x(exp.shape().first), size_y(exp.shape().second),
+        ld(_leading_dim<T>(ploy::inner(size_x, size_y))),
+        _array(ploy::outer(size_x, size_y) * ld) {
+    ploy::for_each(size_x, size_y, [&](const sz_t &i, const sz_t &j) {
+      (*this)(i, j) = exp(i, j);
+    });
+  }
+
+  /**
+   * @brief      Initialization with a chain of matrix products, evaluated in
+   *             the cheapest order for the runtime shapes
+   *
+   * @param[in]  exp   The product expression
+   *
+   * @tparam     R1    Left operand of the product
+   * @tparam     R2    Right operand of the product
+   */
+  template <typename R1, typename R2>
+  lazy_matrix(const expr<R1, R2, _std_mul> &exp)
+      : lazy_matrix(exp.shape().first, exp.shape().second) {
+    _chain_product(exp, *this);
   }
 
   /**
@@ -357,9 +696,38 @@ public:
   decltype(auto) shape() const { return std::make_pair(size_x, size_y); }
   /**
    * @brief      function for getting processed data i.e. member _array which is
-   *             processed under row_major or column_major;
+   *             processed under row_major or column_major, without the
+   *             padding at the end of each row or column;
+   */
+  decltype(auto) pcd_data() const {
+    const sz_t in = ploy::inner(size_x, size_y);
+    std::vector<T> data;
+    data.reserve(size_x * size_y);
+    for (sz_t k = 0; k < ploy::outer(size_x, size_y); k++) {
+      data.insert(data.end(), _array.begin() + k * ld,
+                  _array.begin() + k * ld + in);
+    }
+    return data;
+  }
+  /**
+   * @brief      Gives the leading dimension, i.e. the distance in elements
+   *             between consecutive rows (row_major) or columns
+   *             (column_major) of data()
+   */
+  sz_t leading_dim() const { return ld; }
+  /**
+   * @brief      Gives the raw, padded storage of the matrix
+   */
+  T *data() { return _array.data(); }
+  const T *data() const { return _array.data(); }
+  /**
+   * @brief      Gives the NUMA nodes holding the matrix
+   *
+   * @return     map from node to the number of pages of the matrix on it
    */
-  decltype(auto) pcd_data() const { return _array; }
+  decltype(auto) numa_nodes() const {
+    return numa::nodes(_array.data(), _array.size() * sizeof(T));
+  }
   /**
    * Operator () Overloading for getting the (i,j)th element
    */
@@ -398,18 +766,28 @@ public:
   template <typename R1> lazy_matrix operator=(const R1 &other) {
     assert(shape() == other.shape());
     lazy_matrix<T, ploy> temp(size_x, size_y);
-#pragma omp parallel for
-    for (sz_t i = 0; i < size_x; i++) {
-      for (sz_t j = 0; j < size_y; j++) {
-        temp(i, j) = other(i, j);
-      }
-    }
-#pragma omp parallel for
-    for (sz_t i = 0; i < size_x; i++) {
-      for (sz_t j = 0; j < size_y; j++) {
-        (*this)(i, j) = temp(i, j);
-      }
-    }
+    ploy::for_each(size_x, size_y, [&](const sz_t &i, const sz_t &j) {
+      temp(i, j) = other(i, j);
+    });
+    ploy::for_each(size_x, size_y, [&](const sz_t &i, const sz_t &j) {
+      (*this)(i, j) = temp(i, j);
+    });
+    return *this;
+  }
+
+  /**
+   * @brief      Overloading operator = for a assignment of a chain of matrix
+   *             products, evaluated in the cheapest order
+   *
+   * @param[in]  other  the product expression
+   */
+  template <typename R1, typename R2>
+  lazy_matrix operator=(const expr<R1, R2, _std_mul> &other) {
+    assert(shape() == other.shape());
+    lazy_matrix<T, ploy> temp(other);
+    ploy::for_each(size_x, size_y, [&](const sz_t &i, const sz_t &j) {
+      (*this)(i, j) = temp(i, j);
+    });
     return *this;
   }
 
@@ -446,7 +824,8 @@ public:
    *
    * @tparam     R1     matrix or expression
    */
-  template <typename R1> decltype(auto) operator+(const R1 &other) {
+  template <typename R1, typename = std::enable_if_t<_is_matrix<R1>::value>>
+  decltype(auto) operator+(const R1 &other) {
     assert(shape() == other.shape());
     return expr<lazy_matrix<T, ploy>, R1, _add>(*this, other, _add());
   }
@@ -464,7 +843,8 @@ public:
    *
    * @tparam     R1     matrix or expression
    */
-  template <typename R1> decltype(auto) operator-(const R1 &other) {
+  template <typename R1, typename = std::enable_if_t<_is_matrix<R1>::value>>
+  decltype(auto) operator-(const R1 &other) {
     assert(shape() == other.shape());
     return expr<lazy_matrix<T, ploy>, R1, _sub>(*this, other, _sub());
   }
@@ -483,7 +863,8 @@ public:
    *
    * @tparam     R1     matrix or expression
    */
-  template <typename R1> decltype(auto) operator/(const R1 &other) {
+  template <typename R1, typename = std::enable_if_t<_is_matrix<R1>::value>>
+  decltype(auto) operator/(const R1 &other) {
     assert(shape() == other.shape());
     return expr<lazy_matrix<T, ploy>, R1, _ediv>(*this, other, _ediv());
   }
@@ -502,7 +883,8 @@ public:
    *
    * @tparam     R1     matrix or expression
    */
-  template <typename R1> decltype(auto) operator*(const R1 &other) {
+  template <typename R1, typename = std::enable_if_t<_is_matrix<R1>::value>>
+  decltype(auto) operator*(const R1 &other) {
     assert(shape() == other.shape());
     return expr<lazy_matrix<T, ploy>, R1, _emul>(*this, other, _emul());
   }
@@ -521,7 +903,8 @@ public:
    *
    * @tparam     R1     matrix or expression
    */
-  template <typename R1> decltype(auto) operator%(const R1 &other) {
+  template <typename R1, typename = std::enable_if_t<_is_matrix<R1>::value>>
+  decltype(auto) operator%(const R1 &other) {
     assert(shape().second == other.shape().first);
     return expr<lazy_matrix<T, ploy>, R1, _std_mul>(*this, other, _std_mul());
   }
@@ -532,4 +915,221 @@ public:
     auto temp = (*this) % other;
     *this = temp;
   }
-};
\ No newline at end of file
+};
+/**
+ * @brief      Computes c = a % b with a tiled loop, the row tiles of c being
+ *             split between threads and the structural zeros of a and b
+ *             skipped. c must be zero on entry.
+ */
+template <typename R1, typename R2, typename R3>
+void _gemm(const R1 &a, const R2 &b, R3 &c) {
+  const sz_t n = a.shape().first;
+  const sz_t l = a.shape().second;
+  const sz_t m = b.shape().second;
+  assert(l == b.shape().first && c.shape() == std::make_pair(n, m));
+#pragma omp parallel for schedule(static)
+  for (sz_t ti = 0; ti < n; ti += _tile_size) {
+    const sz_t ei = std::min(ti + _tile_size, n);
+    for (sz_t tk = 0; tk < l; tk += _tile_size) {
+      const sz_t ek = std::min(tk + _tile_size, l);
+      for (sz_t tj = 0; tj < m; tj += _tile_size) {
+        const sz_t ej = std::min(tj + _tile_size, m);
+        for (sz_t i = ti; i < ei; i++) {
+          const auto r = _row_support(a, i);
+          const sz_t hk = std::min(ek, r.second);
+          for (sz_t k = std::max(tk, r.first); k < hk; k++) {
+            const auto aik = a(i, k);
+            const auto s = _row_support(b, k);
+            const sz_t hj = std::min(ej, s.second);
+            for (sz_t j = std::max(tj, s.first); j < hj; j++) {
+              c(i, j) += aik * b(k, j);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief      Flattens a chain of matrix products into a tuple of references
+ *             to its factors
+ */
+template <typename R> decltype(auto) _chain_factors(const R &a) {
+  return std::tie(a);
+}
+template <typename R1, typename R2>
+decltype(auto) _chain_factors(const expr<R1, R2, _std_mul> &exp) {
+  return std::tuple_cat(_chain_factors(exp.lhs()), _chain_factors(exp.rhs()));
+}
+
+/**
+ * @brief      Calls f with a factor that is cheap to index: matrices are
+ *             passed as they are, other expressions are evaluated once into a
+ *             temporary instead of once per access of the product.
+ */
+template <typename T, typename R, typename F>
+void _with_factor(const R &a, const F &f) {
+  f(a);
+}
+template <typename T, typename R1, typename R2, typename Op, typename F>
+void _with_factor(const expr<R1, R2, Op> &a, const F &f) {
+  const lazy_matrix<T> temp(a);
+  f(temp);
+}
+
+/**
+ * @brief      Calls f with the k-th factor of the tuple
+ */
+template <typename T, typename Tup, typename F, sz_t... I>
+void _visit_factor(const Tup &factors, const sz_t &k, const F &f,
+                   std::index_sequence<I...>) {
+  ((k == I ? _with_factor<T>(std::get<I>(factors), f) : void()), ...);
+}
+
+/**
+ * @brief      Evaluates the product of factors i..j into c following the
+ *             split points found by _chain_product
+ */
+template <typename T, typename Tup, typename R>
+void _chain_eval(const Tup &factors, const std::vector<sz_t> &split,
+                 const std::vector<sz_t> &dims, const sz_t &i, const sz_t &j,
+                 R &c) {
+  constexpr sz_t N = std::tuple_size<Tup>::value;
+  const sz_t k = split[i * N + j];
+  // calls g with the product of factors p..q, materialized if p < q
+  auto with = [&](const sz_t &p, const sz_t &q, const auto &g) {
+    if (p == q) {
+      _visit_factor<T>(factors, p, g, std::make_index_sequence<N>());
+    } else {
+      lazy_matrix<T> temp(dims[p], dims[q + 1]);
+      _chain_eval<T>(factors, split, dims, p, q, temp);
+      g(temp);
+    }
+  };
+  with(i, k, [&](const auto &a) {
+    with(k + 1, j, [&](const auto &b) { _gemm(a, b, c); });
+  });
+}
+
+/**
+ * @brief      Evaluates a chain of matrix products such as A % B % C % D
+ *             into dest, choosing the parenthesization with the fewest
+ *             multiplications for the runtime shapes (classic O(N^3)
+ *             matrix-chain dynamic programming). dest must be zero on entry.
+ *
+ * @param[in]  exp   The product expression
+ * @param      dest  The matrix receiving the result
+ */
+template <typename R1, typename R2, typename T, typename ploy>
+void _chain_product(const expr<R1, R2, _std_mul> &exp,
+                    lazy_matrix<T, ploy> &dest) {
+  const auto factors = _chain_factors(exp);
+  constexpr sz_t N = std::tuple_size<decltype(factors)>::value;
+  std::vector<sz_t> dims(N + 1);
+  std::apply(
+      [&](const auto &... f) {
+        sz_t k = 0;
+        dims[0] = std::get<0>(factors).shape().first;
+        ((dims[++k] = f.shape().second), ...);
+      },
+      factors);
+  // cost[i * N + j] : fewest multiplications for factors i..j
+  std::vector<double> cost(N * N, 0);
+  std::vector<sz_t> split(N * N, 0);
+  for (sz_t len = 1; len < N; len++) {
+    for (sz_t i = 0; i + len < N; i++) {
+      const sz_t j = i + len;
+      cost[i * N + j] = -1;
+      for (sz_t k = i; k < j; k++) {
+        const double c = cost[i * N + k] + cost[(k + 1) * N + j] +
+                         double(dims[i]) * dims[k + 1] * dims[j + 1];
+        if (cost[i * N + j] < 0 || c < cost[i * N + j]) {
+          cost[i * N + j] = c;
+          split[i * N + j] = k;
+        }
+      }
+    }
+  }
+  _chain_eval<T>(factors, split, dims, 0, N - 1, dest);
+}
+
+/**
+ * @brief      Gives an expression as it is, or evaluated into a temporary
+ *             when it contains a product, a product at its root going
+ *             through _chain_product
+ */
+template <typename R> decltype(auto) _without_product(const R &e) {
+  if constexpr (_has_product<R>::value) {
+    return lazy_matrix<std::decay_t<decltype(e(0, 0))>>(e);
+  } else {
+    return e;
+  }
+}
+
+/**
+ * @brief      Class for assigning several expressions in a single pass.
+ *
+ *             lazy_tie(s, d, p) = std::make_tuple(a + b, a - b, a * b);
+ *
+ *             All expressions are evaluated tile by tile in one loop, so
+ *             every element of a shared operand is streamed from memory once
+ *             instead of once per result. The values of an element are all
+ *             computed before any of them is stored, which keeps element-wise
+ *             expressions that read a destination correct. Expressions using
+ *             operator % read whole rows and columns and are evaluated into
+ *             temporaries before the loop.
+ *
+ * @tparam     M     Types of the destination matrices
+ */
+template <typename... M> class lazy_tie {
+private:
+  std::tuple<M &...> dest;
+
+  template <typename R, sz_t... I>
+  void _assign(const R &exps, std::index_sequence<I...>) {
+    const sz_t size_x = std::get<0>(dest).shape().first;
+    const sz_t size_y = std::get<0>(dest).shape().second;
+    assert(((std::get<I>(dest).shape() == std::get<0>(dest).shape()) && ...));
+    assert(((std::get<I>(exps).shape() == std::get<I>(dest).shape()) && ...));
+    const std::tuple<decltype(_without_product(std::get<I>(exps)))...> ops(
+        _without_product(std::get<I>(exps))...);
+#pragma omp parallel for schedule(static)
+    for (sz_t ti = 0; ti < size_x; ti += _tile_size) {
+      const sz_t ei = std::min(ti + _tile_size, size_x);
+      for (sz_t tj = 0; tj < size_y; tj += _tile_size) {
+        const sz_t ej = std::min(tj + _tile_size, size_y);
+        for (sz_t i = ti; i < ei; i++) {
+          for (sz_t j = tj; j < ej; j++) {
+            auto vals = std::make_tuple(std::get<I>(ops)(i, j)...);
+            ((std::get<I>(dest)(i, j) = std::get<I>(vals)), ...);
+          }
+        }
+      }
+    }
+  }
+
+public:
+  /**
+   * @brief      Constructs the object.
+   *
+   * @param      m     Matrices receiving the results, all of the same shape
+   */
+  lazy_tie(M &... m) : dest(m...) {}
+
+  /**
+   * @brief      Overloading operator = for assigning one expression to each
+   *             tied matrix
+   *
+   * @param[in]  exps  tuple of matrices or expressions, in the same order as
+   *                   the tied matrices
+   *
+   * @tparam     R     matrix or expression types
+   */
+  template <typename... R> lazy_tie &operator=(const std::tuple<R...> &exps) {
+    static_assert(sizeof...(R) == sizeof...(M),
+                  "lazy_tie needs one expression per matrix");
+    _assign(exps, std::index_sequence_for<M...>());
+    return *this;
+  }
+};
@@ -0,0 +1,467 @@
+#pragma once
+#include "lazy_matrix.h"
+#include <initializer_list>
+#include <vector>
+
+/**
+ * @brief      Whether a vector is a column (n x 1) or a row (1 x n)
+ */
+enum class orientation { column, row };
+
+template <typename T, orientation o = orientation::column> class lazy_vector;
+template <typename T, typename R>
+void _gemv(const R &a, const T *x, T *y, const T &alpha, const T &beta);
+template <typename T, typename R>
+void _gevm(const R &a, const T *x, T *y, const T &alpha, const T &beta);
+
+/**
+ * @brief      Calls f with the contiguous elements of a, which is evaluated
+ *             into a temporary vector first unless it is one already
+ */
+template <typename T, orientation o, typename R, typename F>
+void _with_vector(const R &a, const F &f) {
+  const lazy_vector<T, o> temp(a);
+  f(temp.data());
+}
+template <typename T, orientation o, orientation o2, typename F>
+void _with_vector(const lazy_vector<T, o2> &a, const F &f) {
+  f(a.data());
+}
+
+/**
+ * @brief      Class for a dense vector, stored contiguously.
+ *
+ *             A vector is an operand of expressions like an n x 1 or 1 x n
+ *             matrix. Products with it are not evaluated per element through
+ *             _std_mul: assigning A % x to a column vector, or x % A to a
+ *             row vector, runs the GEMV kernels, which stream A once in its
+ *             storage order, and chains of products are applied to the
+ *             vector one factor at a time.
+ *
+ * @tparam     T     Data type of the vector
+ * @tparam     o     orientation::column or orientation::row
+ */
+template <typename T, orientation o>
+class lazy_vector : public expr_ops<lazy_vector<T, o>> {
+private:
+  std::vector<T, numa::allocator<T>> _array;
+
+  /**
+   * @brief      Writes other to every element, the elements being split
+   *             statically between threads so each page is first touched by
+   *             the thread that later evaluates it
+   */
+  template <typename R1> void _assign(const R1 &other) {
+    T *p = _array.data();
+    const sz_t n = _array.size();
+#pragma omp parallel for simd schedule(static)
+    for (sz_t k = 0; k < n; k++) {
+      p[k] = o == orientation::column ? other(k, 0) : other(0, k);
+    }
+  }
+
+  /**
+   * @brief      Evaluates a product into this vector, which may be one of its
+   *             operands
+   */
+  template <typename R1, typename R2>
+  void _assign_product(const expr<R1, R2, _std_mul> &exp) {
+    lazy_vector temp(size());
+    if (o == orientation::column) {
+      _with_vector<T, o>(exp.rhs(), [&](const T *x) {
+        _gemv(exp.lhs(), x, temp.data(), T(1), T());
+      });
+    } else {
+      _with_vector<T, o>(exp.lhs(), [&](const T *x) {
+        _gevm(exp.rhs(), x, temp.data(), T(1), T());
+      });
+    }
+    _array.swap(temp._array);
+  }
+
+public:
+  using value_type = T;
+
+  /**
+   * @brief      Constructs the object.
+   *
+   * @param[in]  n     Number of elements in the vector
+   * @param[in]  val   The initial value
+   */
+  lazy_vector(const sz_t &n, const T &val = T()) : _array(n) {
+    T *p = _array.data();
+#pragma omp parallel for simd schedule(static)
+    for (sz_t k = 0; k < n; k++) {
+      p[k] = val;
+    }
+  }
+
+  /**
+   * @brief      Initialization with a list
+   */
+  lazy_vector(const std::initializer_list<T> &l) : lazy_vector(l.size()) {
+    std::copy(l.begin(), l.end(), _array.begin());
+  }
+  /**
+   * @brief      Initialization with a std::vector
+   */
+  lazy_vector(const std::vector<T> &vec) : lazy_vector(vec.size()) {
+    std::copy(vec.begin(), vec.end(), _array.begin());
+  }
+
+  lazy_vector(const lazy_vector &other) : lazy_vector(other.size()) {
+    _assign(other);
+  }
+
+  /**
+   * @brief      Initialization with a matrix or an expression with one
+   *             column (column vectors) or one row (row vectors)
+   */
+  template <typename R1, typename = std::enable_if_t<_is_matrix<R1>::value>>
+  lazy_vector(const R1 &other)
+      : lazy_vector(o == orientation::column ? other.shape().first
+                                             : other.shape().second) {
+    assert(other.shape() == shape());
+    _assign(other);
+  }
+  /**
+   * @brief      Initialization with a product, through GEMV
+   */
+  template <typename R1, typename R2>
+  lazy_vector(const expr<R1, R2, _std_mul> &exp)
+      : lazy_vector(o == orientation::column ? exp.shape().first
+                                             : exp.shape().second) {
+    assert(exp.shape() == shape());
+    _assign_product(exp);
+  }
+
+  /**
+   * @brief      Gives the number of elements
+   */
+  sz_t size() const { return _array.size(); }
+  /**
+   * @brief      Gives the dimensions of the vector as a matrix
+   */
+  decltype(auto) shape() const {
+    return o == orientation::column ? std::make_pair(size(), sz_t(1))
+                                    : std::make_pair(sz_t(1), size());
+  }
+  /**
+   * @brief      Gives the storage of the vector
+   */
+  T *data() { return _array.data(); }
+  const T *data() const { return _array.data(); }
+
+  /**
+   * Operator [] Overloading for the kth element
+   */
+  inline const T operator[](const sz_t k) const { return _array[k]; }
+  inline T &operator[](const sz_t k) { return _array[k]; }
+  /**
+   * Operator () Overloading for the (i,j)th element, one of i and j being 0
+   */
+  inline const T operator()(const sz_t i, const sz_t j) const {
+    return _array[i + j];
+  }
+  inline T &operator()(const sz_t i, const sz_t j) { return _array[i + j]; }
+
+  /**
+   * @brief      Oveloading operator << to use std:: cout
+   */
+  friend std::ostream &operator<<(std::ostream &out, const lazy_vector &other) {
+    const char sep = o == orientation::column ? '\n' : ' ';
+    for (sz_t k = 0; k < other.size(); k++) {
+      out << other[k] << sep;
+    }
+    if (o == orientation::row) {
+      out << std::endl;
+    }
+    return out;
+  }
+
+  /**
+   * @brief      Overloading operator = for a assignment of a matrix or an
+   *             expression
+   *
+   *             Element-wise expressions are computed and stored one element
+   *             at a time, so they may read this vector. Expressions
+   *             containing a product, e.g. alpha * A % x + beta * y, read the
+   *             whole of its operands and are evaluated into a temporary
+   *             first, the product being computed per element; only gemv()
+   *             fuses the scaling and the sum into one pass over A.
+   */
+  template <typename R1> lazy_vector &operator=(const R1 &other) {
+    assert(shape() == other.shape());
+    if constexpr (_has_product<R1>::value) {
+      lazy_vector temp(size());
+      temp._assign(other);
+      _array.swap(temp._array);
+    } else {
+      _assign(other);
+    }
+    return *this;
+  }
+  lazy_vector &operator=(const lazy_vector &other) {
+    return operator=<lazy_vector>(other);
+  }
+  /**
+   * @brief      Overloading operator = for a assignment of a product, through
+   *             GEMV
+   */
+  template <typename R1, typename R2>
+  lazy_vector &operator=(const expr<R1, R2, _std_mul> &exp) {
+    assert(shape() == exp.shape());
+    _assign_product(exp);
+    return *this;
+  }
+
+  /**
+   * @brief      Overloading operator == for a comparing equality with other
+   *             matrix
+   */
+  template <typename R1> bool operator==(const R1 &other) const {
+    if (shape() != other.shape()) {
+      return false;
+    }
+    for (sz_t k = 0; k < size(); k++) {
+      if ((*this)[k] != (o == orientation::column ? other(k, 0) : other(0, k))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief      assignment after adding; an operand containing a product is
+   *             evaluated first, through GEMV when it is the product itself
+   */
+  template <typename R1> void operator+=(const R1 &other) {
+    if constexpr (_has_product<R1>::value) {
+      *this = *this + lazy_vector(other);
+    } else {
+      *this = *this + other;
+    }
+  }
+  /**
+   * @brief      assignment after subtracting; an operand containing a
+   *             product is evaluated first, through GEMV when it is the
+   *             product itself
+   */
+  template <typename R1> void operator-=(const R1 &other) {
+    if constexpr (_has_product<R1>::value) {
+      *this = *this - lazy_vector(other);
+    } else {
+      *this = *this - other;
+    }
+  }
+  /**
+   * @brief      assignment after element-wise division
+   */
+  template <typename R1> void operator/=(const R1 &other) {
+    *this = *this / other;
+  }
+  /**
+   * @brief      assignment after element-wise multiplication
+   */
+  template <typename R1> void operator*=(const R1 &other) {
+    *this = *this * other;
+  }
+};
+
+/**
+ * @brief      y = alpha a % x + beta y for an n x m matrix a whose element
+ *             (i, k) is a[i * lda + k]: one dot product per row, the rows
+ *             being split between threads
+ */
+template <typename T>
+void _gemv_rows(const sz_t &n, const sz_t &m, const T *a, const sz_t &lda,
+                const T *x, T *y, const T &alpha, const T &beta) {
+#pragma omp parallel for schedule(static)
+  for (sz_t i = 0; i < n; i++) {
+    const T *row = a + i * lda;
+    T sum{};
+#pragma omp simd reduction(+ : sum)
+    for (sz_t k = 0; k < m; k++) {
+      sum += row[k] * x[k];
+    }
+    // beta == 0 ignores y, which may be uninitialised
+    y[i] = alpha * sum + (beta == T() ? T() : beta * y[i]);
+  }
+}
+
+/**
+ * @brief      y = alpha a % x + beta y for an n x m matrix a whose element
+ *             (i, k) is a[k * lda + i]: y is split into blocks small enough to
+ *             stay in L1, one per thread at a time, and every column adds its
+ *             part of the block to it
+ */
+template <typename T>
+void _gemv_cols(const sz_t &n, const sz_t &m, const T *a, const sz_t &lda,
+                const T *x, T *y, const T &alpha, const T &beta) {
+  constexpr sz_t block = 4 * _tile_size;
+#pragma omp parallel for schedule(static)
+  for (sz_t ti = 0; ti < n; ti += block) {
+    const sz_t ei = std::min(ti + block, n);
+    for (sz_t i = ti; i < ei; i++) {
+      y[i] = beta == T() ? T() : beta * y[i];
+    }
+    // four columns per sweep, so the block of y is loaded and stored once
+    // for every four columns read
+    sz_t k = 0;
+    for (; k + 4 <= m; k += 4) {
+      const T *c0 = a + k * lda;
+      const T *c1 = c0 + lda;
+      const T *c2 = c1 + lda;
+      const T *c3 = c2 + lda;
+      const T x0 = alpha * x[k];
+      const T x1 = alpha * x[k + 1];
+      const T x2 = alpha * x[k + 2];
+      const T x3 = alpha * x[k + 3];
+#pragma omp simd
+      for (sz_t i = ti; i < ei; i++) {
+        y[i] += c0[i] * x0 + c1[i] * x1 + c2[i] * x2 + c3[i] * x3;
+      }
+    }
+    for (; k < m; k++) {
+      const T *col = a + k * lda;
+      const T axk = alpha * x[k];
+#pragma omp simd
+      for (sz_t i = ti; i < ei; i++) {
+        y[i] += col[i] * axk;
+      }
+    }
+  }
+}
+
+/**
+ * @brief      y = alpha a % x + beta y, x and y being contiguous. Matrices are
+ *             streamed in their storage order, chains of products are applied
+ *             right to left and other expressions are evaluated on the fly,
+ *             skipping structural zeros.
+ */
+template <typename T, typename R>
+void _gemv(const R &a, const T *x, T *y, const T &alpha, const T &beta) {
+  const sz_t n = a.shape().first;
+#pragma omp parallel for schedule(static)
+  for (sz_t i = 0; i < n; i++) {
+    const auto r = _row_support(a, i);
+    T sum{};
+    for (sz_t k = r.first; k < r.second; k++) {
+      sum += a(i, k) * x[k];
+    }
+    y[i] = alpha * sum + (beta == T() ? T() : beta * y[i]);
+  }
+}
+template <typename T>
+void _gemv(const lazy_matrix<T, policy::row_major> &a, const T *x, T *y,
+           const T &alpha, const T &beta) {
+  _gemv_rows(a.shape().first, a.shape().second, a.data(), a.leading_dim(), x,
+             y, alpha, beta);
+}
+template <typename T>
+void _gemv(const lazy_matrix<T, policy::column_major> &a, const T *x, T *y,
+           const T &alpha, const T &beta) {
+  _gemv_cols(a.shape().first, a.shape().second, a.data(), a.leading_dim(), x,
+             y, alpha, beta);
+}
+template <typename T, typename R1, typename R2>
+void _gemv(const expr<R1, R2, _std_mul> &a, const T *x, T *y, const T &alpha,
+           const T &beta) {
+  std::vector<T> t(a.rhs().shape().first);
+  _gemv(a.rhs(), x, t.data(), T(1), T());
+  _gemv(a.lhs(), t.data(), y, alpha, beta);
+}
+
+/**
+ * @brief      y = alpha x % a + beta y for row vectors x and y, i.e. GEMV with
+ *             the transpose of a, which swaps the kernels of the two policies;
+ *             chains of products are applied left to right
+ */
+template <typename T, typename R>
+void _gevm(const R &a, const T *x, T *y, const T &alpha, const T &beta) {
+  const sz_t m = a.shape().second;
+#pragma omp parallel for schedule(static)
+  for (sz_t j = 0; j < m; j++) {
+    const auto c = _col_support(a, j);
+    T sum{};
+    for (sz_t k = c.first; k < c.second; k++) {
+      sum += x[k] * a(k, j);
+    }
+    y[j] = alpha * sum + (beta == T() ? T() : beta * y[j]);
+  }
+}
+template <typename T>
+void _gevm(const lazy_matrix<T, policy::row_major> &a, const T *x, T *y,
+           const T &alpha, const T &beta) {
+  _gemv_cols(a.shape().second, a.shape().first, a.data(), a.leading_dim(), x,
+             y, alpha, beta);
+}
+template <typename T>
+void _gevm(const lazy_matrix<T, policy::column_major> &a, const T *x, T *y,
+           const T &alpha, const T &beta) {
+  _gemv_rows(a.shape().second, a.shape().first, a.data(), a.leading_dim(), x,
+             y, alpha, beta);
+}
+template <typename T, typename R1, typename R2>
+void _gevm(const expr<R1, R2, _std_mul> &a, const T *x, T *y, const T &alpha,
+           const T &beta) {
+  std::vector<T> t(a.lhs().shape().second);
+  _gevm(a.lhs(), x, t.data(), T(1), T());
+  _gevm(a.rhs(), t.data(), y, alpha, beta);
+}
+
+/**
+ * @brief      Computes y = alpha * a % x + beta * y in one pass over a (GEMV).
+ *             y must not be x.
+ *
+ * @param[in]  alpha  Scale of the product
+ * @param[in]  a      The n x m matrix or expression
+ * @param[in]  x      The m x 1 vector or expression
+ * @param[in]  beta   Scale of y, y being ignored when beta is 0
+ * @param      y      The n x 1 result
+ */
+template <typename T, typename R1, typename R2>
+void gemv(const T &alpha, const R1 &a, const R2 &x, const T &beta,
+          lazy_vector<T, orientation::column> &y) {
+  assert(a.shape().second == x.shape().first &&
+         a.shape().first == y.size());
+  _with_vector<T, orientation::column>(
+      x, [&](const T *px) { _gemv(a, px, y.data(), alpha, beta); });
+}
+
+/**
+ * @brief      Computes a += alpha * x % y^T (GER), a being walked in its
+ *             storage order
+ *
+ * @param[in]  alpha  Scale of the update
+ * @param[in]  x      The n elements vector
+ * @param[in]  y      The m elements vector
+ * @param      a      The n x m matrix
+ */
+template <typename T, orientation o1, orientation o2, typename ploy>
+void ger(const T &alpha, const lazy_vector<T, o1> &x,
+         const lazy_vector<T, o2> &y, lazy_matrix<T, ploy> &a) {
+  assert(a.shape() == std::make_pair(x.size(), y.size()));
+  const T *px = x.data();
+  const T *py = y.data();
+  ploy::for_each(a.shape().first, a.shape().second,
+                 [&](const sz_t &i, const sz_t &j) {
+                   a(i, j) += alpha * px[i] * py[j];
+                 });
+}
+
+/**
+ * @brief      Gives the dot product of two vectors of either orientation
+ */
+template <typename T, orientation o1, orientation o2>
+T dot(const lazy_vector<T, o1> &x, const lazy_vector<T, o2> &y) {
+  assert(x.size() == y.size());
+  const T *px = x.data();
+  const T *py = y.data();
+  T sum{};
+#pragma omp parallel for simd reduction(+ : sum) schedule(static)
+  for (sz_t k = 0; k < x.size(); k++) {
+    sum += px[k] * py[k];
+  }
+  return sum;
+}
@@ -0,0 +1,169 @@
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <utility>
+#include <vector>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace numa {
+/**
+ * @brief      Where the pages of a matrix are placed
+ *
+ *             first_touch : each page lands on the node of the thread that
+ *                           first writes it (the kernel default)
+ *             interleave  : pages are spread round-robin over all nodes
+ *             bind        : all pages are placed on one given node
+ */
+enum class placement { first_touch, interleave, bind };
+
+/**
+ * @brief      Size of the pages the allocator aligns to
+ */
+constexpr std::size_t page_size = 4096;
+
+/**
+ * @brief      Allocator handing out page aligned blocks whose elements are
+ *             default-initialised, so no page is touched until the owner
+ *             fills it.
+ *
+ * @tparam     T     Data type of the elements
+ */
+template <typename T> class allocator {
+public:
+  using value_type = T;
+
+  allocator() = default;
+  template <typename U> allocator(const allocator<U> &) {}
+
+  T *allocate(const std::size_t n) {
+    std::size_t bytes = n * sizeof(T);
+    bytes = (bytes + page_size - 1) / page_size * page_size;
+#ifdef _WIN32
+    void *p = _aligned_malloc(bytes ? bytes : page_size, page_size);
+#else
+    void *p = std::aligned_alloc(page_size, bytes ? bytes : page_size);
+#endif
+    if (p == nullptr) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T *>(p);
+  }
+  void deallocate(T *p, const std::size_t) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+  }
+
+  /**
+   * @brief      Default-initialisation instead of value-initialisation so
+   *             std::vector<T>(n) leaves the pages untouched
+   */
+  template <typename U> void construct(U *p) { ::new (static_cast<void *>(p)) U; }
+  template <typename U, typename... Args>
+  void construct(U *p, Args &&... args) {
+    ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+  }
+
+  template <typename U> bool operator==(const allocator<U> &) const {
+    return true;
+  }
+  template <typename U> bool operator!=(const allocator<U> &) const {
+    return false;
+  }
+};
+
+/**
+ * @brief      Sets the placement policy of a block. Only the whole pages
+ *             inside the block are affected; those already resident, e.g.
+ *             recycled heap memory, are migrated to follow the policy.
+ *
+ * @param      addr   Start of the block
+ * @param[in]  bytes  Size of the block
+ * @param[in]  p      Placement policy
+ * @param[in]  node   Node used by placement::bind
+ *
+ * @return     true if the policy was applied
+ */
+inline bool place(void *addr, const std::size_t bytes, const placement p,
+                  const int node = 0) {
+#if defined(__linux__) && defined(SYS_mbind)
+  if (p == placement::first_touch) {
+    return true;
+  }
+  constexpr int mpol_bind = 2;
+  constexpr int mpol_interleave = 3;
+  // fail with EIO, rather than ignore the policy, if resident pages of the
+  // block cannot be moved
+  constexpr unsigned mpol_mf_strict = 1;
+  constexpr unsigned mpol_mf_move = 2;
+  constexpr unsigned long max_node = 8 * sizeof(unsigned long);
+  if (p == placement::bind && (node < 0 || node >= static_cast<int>(max_node))) {
+    return false;
+  }
+  const std::size_t first =
+      (reinterpret_cast<std::size_t>(addr) + page_size - 1) / page_size *
+      page_size;
+  const std::size_t last =
+      (reinterpret_cast<std::size_t>(addr) + bytes) / page_size * page_size;
+  if (last <= first) {
+    return true;
+  }
+  // the kernel intersects the mask with the online nodes
+  const unsigned long mask =
+      p == placement::bind ? 1UL << node : ~0UL;
+  return syscall(SYS_mbind, first, last - first,
+                 p == placement::bind ? mpol_bind : mpol_interleave, &mask,
+                 max_node, mpol_mf_strict | mpol_mf_move) == 0;
+#else
+  return p == placement::first_touch;
+#endif
+}
+
+/**
+ * @brief      Gives the nodes on which the pages of a block reside
+ *
+ * @param[in]  addr   Start of the block
+ * @param[in]  bytes  Size of the block
+ *
+ * @return     map from node to the number of pages of the block on it; pages
+ *             that were never touched are not counted
+ */
+inline std::map<int, std::size_t> nodes(const void *addr,
+                                        const std::size_t bytes) {
+  std::map<int, std::size_t> count;
+#if defined(__linux__) && defined(SYS_move_pages)
+  if (bytes == 0) {
+    return count;
+  }
+  const std::size_t first =
+      reinterpret_cast<std::size_t>(addr) / page_size * page_size;
+  const std::size_t last = reinterpret_cast<std::size_t>(addr) + bytes;
+  std::vector<void *> pages;
+  for (std::size_t it = first; it < last; it += page_size) {
+    pages.push_back(reinterpret_cast<void *>(it));
+  }
+  std::vector<int> status(pages.size(), -1);
+  // with no target nodes move_pages only reports where each page is
+  if (syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr,
+              status.data(), 0) != 0) {
+    return count;
+  }
+  for (auto &it : status) {
+    if (it >= 0) {
+      count[it]++;
+    }
+  }
+#endif
+  return count;
+}
+}; // namespace numa
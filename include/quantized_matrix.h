@@ -0,0 +1,332 @@
+#pragma once
+#include "lazy_matrix.h"
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief      Granularity of the scale and zero point of a quantized matrix
+ *
+ *             per_matrix : one scale and zero point for all elements
+ *             per_row    : one scale and zero point for each row
+ */
+enum class quantization { per_matrix, per_row };
+
+/**
+ * @brief      Class for a matrix of int8 values q standing for the real
+ *             values scale * (q - zero), stored row by row.
+ *
+ *             Quantizing maps the range [min(x, 0), max(x, 0)] of each row or
+ *             of the whole matrix onto [-128, 127], so zero is represented
+ *             exactly and the rounding error is at most scale / 2. As an
+ *             operand of an expression the matrix reads as its real values,
+ *             so assigning it to a lazy_matrix dequantizes it, and assigning
+ *             an expression to it quantizes the expression. Matrix products
+ *             run on the int8 values through qgemm().
+ *
+ * @tparam     T     Data type of the real values
+ */
+template <typename T = float>
+class quantized_matrix : public expr_ops<quantized_matrix<T>> {
+private:
+  sz_t size_x;
+  sz_t size_y;
+  // rows are padded so that each starts on its own cache line
+  sz_t ld;
+  quantization gran;
+  std::vector<std::int8_t> _array;
+  std::vector<T> scale;
+  std::vector<std::int32_t> zero;
+
+  sz_t _param(const sz_t &i) const {
+    return gran == quantization::per_row ? i : 0;
+  }
+
+  /**
+   * @brief      Chooses the scale and zero point of parameter set p from the
+   *             range [lo, hi] of its values
+   */
+  void _choose(const sz_t &p, T lo, T hi) {
+    lo = std::min(lo, T());
+    hi = std::max(hi, T());
+    scale[p] = hi > lo ? (hi - lo) / T(255) : T(1);
+    zero[p] = static_cast<std::int32_t>(-128 - std::lrint(lo / scale[p]));
+    zero[p] = std::min(std::max(zero[p], -128), 127);
+  }
+
+  /**
+   * @brief      Quantizes the values of other, rows being split between
+   *             threads
+   */
+  template <typename R1> void _quantize(const R1 &other) {
+    const sz_t sets = gran == quantization::per_row ? size_x : 1;
+    std::vector<T> lo(sets, std::numeric_limits<T>::max());
+    std::vector<T> hi(sets, std::numeric_limits<T>::lowest());
+    std::vector<T> vals(size_x * size_y);
+#pragma omp parallel for schedule(static)
+    for (sz_t i = 0; i < size_x; i++) {
+      T l = std::numeric_limits<T>::max();
+      T h = std::numeric_limits<T>::lowest();
+      for (sz_t j = 0; j < size_y; j++) {
+        const T v = other(i, j);
+        vals[i * size_y + j] = v;
+        l = std::min(l, v);
+        h = std::max(h, v);
+      }
+      if (gran == quantization::per_row) {
+        lo[i] = l;
+        hi[i] = h;
+      } else {
+#pragma omp critical
+        {
+          lo[0] = std::min(lo[0], l);
+          hi[0] = std::max(hi[0], h);
+        }
+      }
+    }
+    for (sz_t p = 0; p < sets; p++) {
+      _choose(p, lo[p], hi[p]);
+    }
+#pragma omp parallel for schedule(static)
+    for (sz_t i = 0; i < size_x; i++) {
+      const T inv = T(1) / scale[_param(i)];
+      const std::int32_t z = zero[_param(i)];
+      for (sz_t j = 0; j < size_y; j++) {
+        const long q = std::lrint(vals[i * size_y + j] * inv) + z;
+        _array[i * ld + j] =
+            static_cast<std::int8_t>(std::min(std::max(q, -128L), 127L));
+      }
+    }
+  }
+
+public:
+  /**
+   * @brief      Constructs the object, every element being zero.
+   *
+   * @param[in]  n     Number of rows in the matrix
+   * @param[in]  m     Number of columns in the matrix
+   * @param[in]  g     Granularity of the scales and zero points
+   */
+  quantized_matrix(const sz_t &n, const sz_t &m,
+                   const quantization g = quantization::per_row)
+      : size_x(n), size_y(m), ld(_leading_dim<std::int8_t>(m)), gran(g),
+        _array(n * ld),
+        scale(g == quantization::per_row ? n : 1, T(1)),
+        zero(g == quantization::per_row ? n : 1, 0) {}
+
+  /**
+   * @brief      Quantizes a matrix or an expression
+   *
+   * @param[in]  other  The matrix or expression
+   * @param[in]  g      Granularity of the scales and zero points
+   */
+  template <typename R1, typename = std::enable_if_t<_is_matrix<R1>::value>>
+  quantized_matrix(const R1 &other,
+                   const quantization g = quantization::per_row)
+      : quantized_matrix(other.shape().first, other.shape().second, g) {
+    _quantize(other);
+  }
+
+  /**
+   * @brief      Overloading operator = for quantizing a matrix or an
+   *             expression, the scales and zero points being chosen anew
+   */
+  template <typename R1> quantized_matrix &operator=(const R1 &other) {
+    assert(shape() == other.shape());
+    _quantize(other);
+    return *this;
+  }
+
+  /**
+   * @brief      Gives the dimensions of the matrix
+   */
+  decltype(auto) shape() const { return std::make_pair(size_x, size_y); }
+  /**
+   * @brief      Gives the granularity of the scales and zero points
+   */
+  quantization granularity() const { return gran; }
+  /**
+   * @brief      Gives the leading dimension of data()
+   */
+  sz_t leading_dim() const { return ld; }
+  /**
+   * @brief      Gives the raw, padded int8 storage, row by row
+   */
+  const std::int8_t *data() const { return _array.data(); }
+  /**
+   * @brief      Gives the scale and the zero point of row i
+   */
+  T row_scale(const sz_t &i) const { return scale[_param(i)]; }
+  std::int32_t row_zero(const sz_t &i) const { return zero[_param(i)]; }
+
+  /**
+   * @brief      Gives the int8 value of the (i,j)th element
+   */
+  std::int8_t raw(const sz_t &i, const sz_t &j) const {
+    return _array[i * ld + j];
+  }
+  /**
+   * Operator () Overloading for getting the real value of the (i,j)th
+   * element
+   */
+  inline const T operator()(const sz_t i, const sz_t j) const {
+    const sz_t p = _param(i);
+    return scale[p] * T(std::int32_t(_array[i * ld + j]) - zero[p]);
+  }
+
+  /**
+   * @brief      Oveloading operator << to use std:: cout
+   */
+  friend std::ostream &operator<<(std::ostream &out,
+                                  const quantized_matrix &other) {
+    for (sz_t i = 0; i < other.size_x; i++) {
+      for (sz_t j = 0; j < other.size_y; j++) {
+        out << other(i, j) << ' ';
+      }
+      out << std::endl;
+    }
+    return out;
+  }
+};
+
+/**
+ * @brief      Dot products of row a with the four rows b0..b3, each of
+ *             length n, accumulated in int32.
+ *
+ *             With AVX2 the int8 values are sign extended to int16 and
+ *             multiplied pairwise with madd_epi16, which sums two products
+ *             into an int32 lane without saturating. maddubs_epi16 would
+ *             need one operand unsigned and saturates its int16 pair sums,
+ *             which 2 * 255 * 127 exceeds. Each product is at most
+ *             128 * 128 = 2^14, so the total, whichever lanes it is summed
+ *             through, reaches n * 2^14 and fits an int32 for n below 2^17.
+ */
+inline void _qdot4(const std::int8_t *a, const std::int8_t *const b[4],
+                   const sz_t &n, std::int32_t out[4]) {
+  sz_t k = 0;
+  for (int r = 0; r < 4; r++) {
+    out[r] = 0;
+  }
+#ifdef __AVX2__
+  __m256i acc[4];
+  for (int r = 0; r < 4; r++) {
+    acc[r] = _mm256_setzero_si256();
+  }
+  for (; k + 16 <= n; k += 16) {
+    const __m256i va = _mm256_cvtepi8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + k)));
+    for (int r = 0; r < 4; r++) {
+      const __m256i vb = _mm256_cvtepi8_epi16(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(b[r] + k)));
+      acc[r] = _mm256_add_epi32(acc[r], _mm256_madd_epi16(va, vb));
+    }
+  }
+  for (int r = 0; r < 4; r++) {
+    const __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc[r]),
+                                    _mm256_extracti128_si256(acc[r], 1));
+    const __m128i h = _mm_add_epi32(s, _mm_unpackhi_epi64(s, s));
+    out[r] = _mm_cvtsi128_si32(_mm_add_epi32(h, _mm_srli_si128(h, 4)));
+  }
+#endif
+  for (; k < n; k++) {
+    const std::int32_t x = a[k];
+    for (int r = 0; r < 4; r++) {
+      out[r] += x * b[r][k];
+    }
+  }
+}
+
+/**
+ * @brief      Computes the int32 products c = qa % qb^T of the int8 values,
+ *             i.e. c(i, j) is the dot product of row i of a and row j of b.
+ *             b is thus laid out like the weights of a layer, one output per
+ *             row. Tiles of rows of a are split between threads and each
+ *             walks the rows of b in tiles that stay in cache. k must be
+ *             below 2^17 for the int32 sums not to overflow.
+ *
+ * @param[in]  a     The n x k left operand
+ * @param[in]  b     The m x k right operand
+ * @param      c     The n x m result
+ */
+template <typename T, typename ploy>
+void qgemm(const quantized_matrix<T> &a, const quantized_matrix<T> &b,
+           lazy_matrix<std::int32_t, ploy> &c) {
+  const sz_t n = a.shape().first;
+  const sz_t m = b.shape().first;
+  const sz_t l = a.shape().second;
+  assert(l == b.shape().second && c.shape() == std::make_pair(n, m));
+  // beyond this the int32 sums of _qdot4 can overflow
+  assert(l < (sz_t(1) << 17));
+  const std::int8_t *pa = a.data();
+  const std::int8_t *pb = b.data();
+  const sz_t lda = a.leading_dim();
+  const sz_t ldb = b.leading_dim();
+#pragma omp parallel for schedule(static)
+  for (sz_t ti = 0; ti < n; ti += _tile_size) {
+    const sz_t ei = std::min(ti + _tile_size, n);
+    for (sz_t tj = 0; tj < m; tj += _tile_size) {
+      const sz_t ej = std::min(tj + _tile_size, m);
+      for (sz_t i = ti; i < ei; i++) {
+        for (sz_t j = tj; j < ej; j += 4) {
+          // rows past the end repeat the last one and are not stored
+          const std::int8_t *rows[4];
+          for (sz_t r = 0; r < 4; r++) {
+            rows[r] = pb + std::min(j + r, ej - 1) * ldb;
+          }
+          std::int32_t out[4];
+          _qdot4(pa + i * lda, rows, l, out);
+          for (sz_t r = 0; r < 4 && j + r < ej; r++) {
+            c(i, j + r) = out[r];
+          }
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief      Computes the real product a % b^T through qgemm().
+ *
+ *             With a = sa (qa - za) and b = sb (qb - zb) row by row,
+ *             (a % b^T)(i, j) = sa_i sb_j (qa_i . qb_j - zb_j sum(qa_i)
+ *             - za_i sum(qb_j) + k za_i zb_j), so the zero points only cost
+ *             one row sum per row of each operand.
+ *
+ * @param[in]  a     The n x k left operand
+ * @param[in]  b     The m x k right operand
+ *
+ * @return     The n x m product
+ */
+template <typename T>
+lazy_matrix<T> qgemm(const quantized_matrix<T> &a,
+                     const quantized_matrix<T> &b) {
+  const sz_t n = a.shape().first;
+  const sz_t m = b.shape().first;
+  const sz_t l = a.shape().second;
+  lazy_matrix<std::int32_t> acc(n, m);
+  qgemm(a, b, acc);
+  const auto row_sums = [&](const quantized_matrix<T> &q) {
+    std::vector<std::int32_t> sums(q.shape().first);
+    for (sz_t i = 0; i < q.shape().first; i++) {
+      for (sz_t k = 0; k < l; k++) {
+        sums[i] += q.raw(i, k);
+      }
+    }
+    return sums;
+  };
+  const auto sa = row_sums(a);
+  const auto sb = row_sums(b);
+  lazy_matrix<T> c(n, m);
+  policy::row_major::for_each(n, m, [&](const sz_t &i, const sz_t &j) {
+    const std::int64_t za = a.row_zero(i);
+    const std::int64_t zb = b.row_zero(j);
+    const std::int64_t v = acc(i, j) - zb * sa[i] - za * sb[j] +
+                           std::int64_t(l) * za * zb;
+    c(i, j) = a.row_scale(i) * b.row_scale(j) * T(v);
+  });
+  return c;
+}
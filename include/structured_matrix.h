@@ -0,0 +1,373 @@
+#pragma once
+#include "lazy_matrix.h"
+#include <stdexcept>
+
+/**
+ * @brief      Which triangle of a matrix holds its entries
+ */
+enum class triangle { lower, upper };
+
+/**
+ * @brief      Base class for matrices that only store part of their entries.
+ *
+ *             The derived class D gives the packed position of a stored
+ *             element through _index(i, j) and the range [first, second) of
+ *             the stored columns of row i through _stored(i). Elements outside
+ *             of the stored part read as zero, except for symmetric matrices
+ *             which map them onto their mirror image. operator() only reads;
+ *             stored elements are written through at().
+ *
+ * @tparam     D     The derived matrix type
+ * @tparam     T     Data type of the matrix
+ */
+template <typename D, typename T> class _structured : public expr_ops<D> {
+protected:
+  std::vector<T> _array;
+  sz_t size_x;
+  sz_t size_y;
+
+  _structured(const sz_t &n, const sz_t &m, const sz_t &count, const T &val)
+      : _array(count, val), size_x(n), size_y(m) {}
+
+  const D &self() const { return static_cast<const D &>(*this); }
+
+  /**
+   * @brief      Writes other(i, j) to every stored element, rows being handed
+   *             out dynamically since their lengths differ. Expressions
+   *             containing a product read whole rows and columns, possibly of
+   *             this matrix, and are evaluated into a temporary first.
+   */
+  template <typename R1> void _assign(const R1 &other) {
+    if constexpr (_has_product<R1>::value) {
+      const lazy_matrix<T> temp(other);
+      _assign(temp);
+    } else {
+#pragma omp parallel for schedule(dynamic, 16)
+      for (sz_t i = 0; i < size_x; i++) {
+        const auto r = self()._stored(i);
+        for (sz_t j = r.first; j < r.second; j++) {
+          _array[self()._index(i, j)] = other(i, j);
+        }
+      }
+    }
+  }
+
+public:
+  /**
+   * @brief      Gives the dimensions of the matrix
+   */
+  decltype(auto) shape() const { return std::make_pair(size_x, size_y); }
+  /**
+   * @brief      Gives the packed storage of the matrix
+   */
+  const std::vector<T> &pcd_data() const { return _array; }
+
+  /**
+   * Operator () Overloading for getting the (i,j)th element
+   */
+  inline const T operator()(const sz_t i, const sz_t j) const {
+    return self()._contains(i, j) ? _array[self()._index(i, j)] : T();
+  }
+  /**
+   * @brief      Gives the stored (i,j)th element for writing
+   *
+   * @throws     std::out_of_range if (i, j) is not stored, e.g. above the
+   *             diagonal of a lower triangular matrix or outside the band
+   */
+  T &at(const sz_t i, const sz_t j) {
+    if (i >= size_x || j >= size_y || !self()._contains(i, j)) {
+      throw std::out_of_range("element outside of the stored part");
+    }
+    return _array[self()._index(i, j)];
+  }
+
+  /**
+   * @brief      Oveloading operator << to use std:: cout
+   */
+  friend std::ostream &operator<<(std::ostream &out, const D &other) {
+    for (sz_t i = 0; i < other.size_x; i++) {
+      for (sz_t j = 0; j < other.size_y; j++) {
+        out << other(i, j) << ' ';
+      }
+      out << std::endl;
+    }
+    return out;
+  }
+
+  /**
+   * @brief      Overloading operator == for a comparing equality with other
+   *             matrix
+   */
+  template <typename R1> bool operator==(const R1 &other) const {
+    if (shape() != other.shape()) {
+      return false;
+    }
+    for (sz_t i = 0; i < size_x; i++) {
+      for (sz_t j = 0; j < size_y; j++) {
+        if ((*this)(i, j) != other(i, j)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+};
+
+/**
+ * @brief      Class for a symmetric matrix, packing the lower triangle row by
+ *             row in n * (n + 1) / 2 elements.
+ *
+ *             Assigning an expression evaluates the lower triangle only, so
+ *             element-wise operations on symmetric operands cost half of the
+ *             dense ones; the expression is assumed to be symmetric.
+ *
+ * @tparam     T     Data type of the matrix
+ */
+template <typename T>
+class symmetric_matrix : public _structured<symmetric_matrix<T>, T> {
+private:
+  using base = _structured<symmetric_matrix<T>, T>;
+  friend base;
+
+  static sz_t _index(sz_t i, sz_t j) {
+    if (i < j) {
+      std::swap(i, j);
+    }
+    return i * (i + 1) / 2 + j;
+  }
+  std::pair<sz_t, sz_t> _stored(const sz_t &i) const {
+    return std::make_pair(sz_t(0), i + 1);
+  }
+  bool _contains(const sz_t &, const sz_t &) const { return true; }
+
+public:
+  /**
+   * @brief      Constructs the object.
+   *
+   * @param[in]  n     Number of rows and columns in the matrix
+   * @param[in]  val   The initial value
+   */
+  symmetric_matrix(const sz_t &n, const T &val = T())
+      : base(n, n, n * (n + 1) / 2, val) {}
+
+  /**
+   * @brief      Initialization with an expression, of which the lower
+   *             triangle is read
+   */
+  template <typename R1, typename R2, typename R3>
+  symmetric_matrix(const expr<R1, R2, R3> &exp)
+      : symmetric_matrix(exp.shape().first) {
+    assert(exp.shape().first == exp.shape().second);
+    base::_assign(exp);
+  }
+
+  /**
+   * @brief      Overloading operator = for a assignment of the lower triangle
+   *             of a matrix or expression
+   */
+  template <typename R1> symmetric_matrix &operator=(const R1 &other) {
+    assert(base::shape() == other.shape());
+    base::_assign(other);
+    return *this;
+  }
+};
+
+/**
+ * @brief      Class for a triangular matrix, packing its triangle row by row
+ *             in n * (n + 1) / 2 elements.
+ *
+ *             Products skip the zero triangle (TRMM), assigning an
+ *             expression evaluates the stored triangle only, and solve()
+ *             performs forward or back substitution.
+ *
+ * @tparam     T     Data type of the matrix
+ * @tparam     tri   triangle::lower or triangle::upper
+ */
+template <typename T, triangle tri = triangle::lower>
+class triangular_matrix : public _structured<triangular_matrix<T, tri>, T> {
+private:
+  using base = _structured<triangular_matrix<T, tri>, T>;
+  friend base;
+
+  sz_t _index(const sz_t &i, const sz_t &j) const {
+    if (tri == triangle::lower) {
+      return i * (i + 1) / 2 + j;
+    }
+    return i * (2 * base::size_x - i + 1) / 2 + (j - i);
+  }
+  std::pair<sz_t, sz_t> _stored(const sz_t &i) const { return row_support(i); }
+  bool _contains(const sz_t &i, const sz_t &j) const {
+    return tri == triangle::lower ? j <= i : i <= j;
+  }
+
+public:
+  /**
+   * @brief      Constructs the object.
+   *
+   * @param[in]  n     Number of rows and columns in the matrix
+   * @param[in]  val   The initial value of the stored triangle
+   */
+  triangular_matrix(const sz_t &n, const T &val = T())
+      : base(n, n, n * (n + 1) / 2, val) {}
+
+  /**
+   * @brief      Initialization with an expression, of which the stored
+   *             triangle is read
+   */
+  template <typename R1, typename R2, typename R3>
+  triangular_matrix(const expr<R1, R2, R3> &exp)
+      : triangular_matrix(exp.shape().first) {
+    assert(exp.shape().first == exp.shape().second);
+    base::_assign(exp);
+  }
+
+  /**
+   * @brief      Overloading operator = for a assignment of the stored
+   *             triangle of a matrix or expression
+   */
+  template <typename R1> triangular_matrix &operator=(const R1 &other) {
+    assert(base::shape() == other.shape());
+    base::_assign(other);
+    return *this;
+  }
+
+  /**
+   * @brief      Gives the range of the columns of row i that may be non-zero
+   */
+  std::pair<sz_t, sz_t> row_support(const sz_t &i) const {
+    return tri == triangle::lower ? std::make_pair(sz_t(0), i + 1)
+                                  : std::make_pair(i, base::size_y);
+  }
+  /**
+   * @brief      Gives the range of the rows of column j that may be non-zero
+   */
+  std::pair<sz_t, sz_t> col_support(const sz_t &j) const {
+    return tri == triangle::lower ? std::make_pair(j, base::size_x)
+                                  : std::make_pair(sz_t(0), j + 1);
+  }
+};
+
+/**
+ * @brief      Class for a banded matrix with kl sub-diagonals and ku
+ *             super-diagonals, storing kl + ku + 1 elements per row.
+ *
+ *             Products only visit the band (banded GEMV / GEMM), and
+ *             assigning an expression evaluates the band only.
+ *
+ * @tparam     T     Data type of the matrix
+ */
+template <typename T>
+class banded_matrix : public _structured<banded_matrix<T>, T> {
+private:
+  using base = _structured<banded_matrix<T>, T>;
+  friend base;
+  sz_t kl;
+  sz_t ku;
+
+  sz_t _index(const sz_t &i, const sz_t &j) const {
+    return i * (kl + ku + 1) + (j + kl - i);
+  }
+  std::pair<sz_t, sz_t> _stored(const sz_t &i) const { return row_support(i); }
+  bool _contains(const sz_t &i, const sz_t &j) const {
+    return j + kl >= i && j <= i + ku;
+  }
+
+public:
+  /**
+   * @brief      Constructs the object.
+   *
+   * @param[in]  n     Number of rows in the matrix
+   * @param[in]  m     Number of columns in the matrix
+   * @param[in]  l     Number of sub-diagonals
+   * @param[in]  u     Number of super-diagonals
+   * @param[in]  val   The initial value of the band
+   */
+  banded_matrix(const sz_t &n, const sz_t &m, const sz_t &l, const sz_t &u,
+                const T &val = T())
+      : base(n, m, n * (l + u + 1), val), kl(l), ku(u) {}
+
+  /**
+   * @brief      Initialization with the band of an expression
+   */
+  template <typename R1, typename R2, typename R3>
+  banded_matrix(const expr<R1, R2, R3> &exp, const sz_t &l, const sz_t &u)
+      : banded_matrix(exp.shape().first, exp.shape().second, l, u) {
+    base::_assign(exp);
+  }
+
+  /**
+   * @brief      Overloading operator = for a assignment of the band of a
+   *             matrix or expression
+   */
+  template <typename R1> banded_matrix &operator=(const R1 &other) {
+    assert(base::shape() == other.shape());
+    base::_assign(other);
+    return *this;
+  }
+
+  /**
+   * @brief      Gives the number of sub- and super-diagonals
+   */
+  decltype(auto) bandwidth() const { return std::make_pair(kl, ku); }
+
+  /**
+   * @brief      Gives the range of the columns of row i that may be non-zero
+   */
+  std::pair<sz_t, sz_t> row_support(const sz_t &i) const {
+    return std::make_pair(i > kl ? i - kl : sz_t(0),
+                          std::min(i + ku + 1, base::size_y));
+  }
+  /**
+   * @brief      Gives the range of the rows of column j that may be non-zero
+   */
+  std::pair<sz_t, sz_t> col_support(const sz_t &j) const {
+    return std::make_pair(j > ku ? j - ku : sz_t(0),
+                          std::min(j + kl + 1, base::size_x));
+  }
+};
+
+/**
+ * @brief      Solves a % x = b in place of b, a being triangular: forward
+ *             substitution for a lower triangle, back substitution for an
+ *             upper one. Only the given triangle of a is read and its
+ *             structural zeros are skipped, so any square matrix, triangular
+ *             or banded matrix can be used. The columns of b are solved in
+ *             parallel.
+ *
+ * @param[in]  a     The triangular matrix
+ * @param      b     The right hand sides, overwritten with the solutions
+ * @param[in]  tri   Triangle of a to use
+ * @param[in]  unit  true if the diagonal of a is taken to be one
+ */
+template <typename R1, typename R2>
+void trsolve(const R1 &a, R2 &b, const triangle tri, const bool unit = false) {
+  const sz_t n = a.shape().first;
+  const sz_t m = b.shape().second;
+  assert(n == a.shape().second && n == b.shape().first);
+#pragma omp parallel for schedule(static)
+  for (sz_t j = 0; j < m; j++) {
+    for (sz_t t = 0; t < n; t++) {
+      const sz_t i = tri == triangle::lower ? t : n - 1 - t;
+      const auto r = _row_support(a, i);
+      const sz_t lo =
+          tri == triangle::lower ? r.first : std::max(r.first, i + 1);
+      const sz_t hi = tri == triangle::lower ? std::min(r.second, i) : r.second;
+      auto sum = b(i, j);
+      for (sz_t k = lo; k < hi; k++) {
+        sum -= a(i, k) * b(k, j);
+      }
+      b(i, j) = unit ? sum : sum / a(i, i);
+    }
+  }
+}
+
+/**
+ * @brief      Solves a % x = b in place of b for a triangular matrix a
+ *
+ * @param[in]  a     The triangular matrix
+ * @param      b     The right hand sides, overwritten with the solutions
+ */
+template <typename T, triangle tri, typename R1>
+void solve(const triangular_matrix<T, tri> &a, R1 &b) {
+  trsolve(a, b, tri);
+}
@@ -0,0 +1,387 @@
+#pragma once
+#include "lazy_matrix.h"
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief      Global write clock. A write stamps the tiles it touches with the
+ *             current value, an evaluation advances it, so a tile changed
+ *             after an evaluation iff its stamp is above the value that
+ *             evaluation read.
+ */
+inline std::atomic<std::uint64_t> _epoch{0};
+
+/**
+ * @brief      Number of tiles needed to cover n elements
+ */
+inline sz_t _tiles(const sz_t &n) { return (n + _tile_size - 1) / _tile_size; }
+
+/**
+ * @brief      One flag per _tile_size x _tile_size tile of an n x m matrix
+ */
+struct _tile_mask {
+  sz_t rows;
+  sz_t cols;
+  std::vector<char> bits;
+
+  _tile_mask(const std::pair<sz_t, sz_t> &shape)
+      : rows(_tiles(shape.first)), cols(_tiles(shape.second)),
+        bits(rows * cols, 0) {}
+  char &operator()(const sz_t &ti, const sz_t &tj) {
+    return bits[ti * cols + tj];
+  }
+};
+
+/**
+ * @brief      Class for a matrix recording, for each tile, when it was last
+ *             written.
+ *
+ *             Writes through operator()(i, j), assign_block(), touch() and
+ *             operator= stamp the tiles they reach, which lets cached
+ *             expressions over the matrix recompute only what changed.
+ *             Reads through a const reference stamp nothing.
+ *
+ * @tparam     T     Data type of the matrix
+ * @tparam     ploy  row_major or column_major policy of the storage
+ */
+template <typename T, typename ploy = policy::row_major>
+class tracked_matrix : public expr_ops<tracked_matrix<T, ploy>> {
+private:
+  lazy_matrix<T, ploy> _matrix;
+  sz_t tiles_x;
+  sz_t tiles_y;
+  std::vector<std::atomic<std::uint64_t>> stamp;
+
+  void _stamp(const sz_t &ti, const sz_t &tj) {
+    stamp[ti * tiles_y + tj].store(_epoch.load(std::memory_order_relaxed),
+                                   std::memory_order_relaxed);
+  }
+
+public:
+  /**
+   * @brief      Constructs the object.
+   *
+   * @param[in]  n     Number of rows in the matrix
+   * @param[in]  m     Number of columns in the matrix
+   * @param[in]  val   The initial value
+   */
+  tracked_matrix(const sz_t &n, const sz_t &m, const T &val = T())
+      : _matrix(n, m, val), tiles_x(_tiles(n)), tiles_y(_tiles(m)),
+        stamp(tiles_x * tiles_y) {
+    touch(0, 0, n, m);
+  }
+
+  /**
+   * @brief      Initialization with a matrix or an expression
+   */
+  template <typename R1, typename = std::enable_if_t<_is_matrix<R1>::value>>
+  tracked_matrix(const R1 &other)
+      : tracked_matrix(other.shape().first, other.shape().second) {
+    *this = other;
+  }
+
+  /**
+   * @brief      Copy constructor, which copies the values and stamps every
+   *             tile
+   */
+  tracked_matrix(const tracked_matrix &other)
+      : tracked_matrix(other.shape().first, other.shape().second) {
+    *this = other;
+  }
+
+  /**
+   * @brief      Gives the dimensions of the matrix
+   */
+  decltype(auto) shape() const { return _matrix.shape(); }
+  /**
+   * @brief      Gives the underlying matrix
+   */
+  const lazy_matrix<T, ploy> &matrix() const { return _matrix; }
+  /**
+   * @brief      Gives the value of the write clock when tile (ti, tj) was
+   *             last written
+   */
+  std::uint64_t tile_epoch(const sz_t &ti, const sz_t &tj) const {
+    return stamp[ti * tiles_y + tj].load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief      Marks the tiles of the r x c block whose top left element is
+   *             (i, j) as written, e.g. after writing it through data()
+   */
+  void touch(const sz_t &i, const sz_t &j, const sz_t &r, const sz_t &c) {
+    if (r == 0 || c == 0) {
+      return;
+    }
+    for (sz_t ti = i / _tile_size; ti <= (i + r - 1) / _tile_size; ti++) {
+      for (sz_t tj = j / _tile_size; tj <= (j + c - 1) / _tile_size; tj++) {
+        _stamp(ti, tj);
+      }
+    }
+  }
+
+  /**
+   * @brief      Writes a matrix or an expression into the block whose top
+   *             left element is (i, j)
+   */
+  template <typename R1>
+  void assign_block(const sz_t &i, const sz_t &j, const R1 &other) {
+    const auto s = other.shape();
+    assert(i + s.first <= shape().first && j + s.second <= shape().second);
+    ploy::for_each(s.first, s.second, [&](const sz_t &r, const sz_t &c) {
+      _matrix(i + r, j + c) = other(r, c);
+    });
+    touch(i, j, s.first, s.second);
+  }
+
+  /**
+   * @brief      Gives the raw, padded storage of the matrix; writes through
+   *             it must be followed by touch()
+   */
+  T *data() { return _matrix.data(); }
+  const T *data() const { return _matrix.data(); }
+
+  /**
+   * Operator () Overloading for getting the (i,j)th element
+   */
+  inline const T operator()(const sz_t i, const sz_t j) const {
+    return _matrix(i, j);
+  }
+  /**
+   * Operator () Overloading for setting the (i,j)th element, which stamps its
+   * tile
+   */
+  inline T &operator()(const sz_t i, const sz_t j) {
+    _stamp(i / _tile_size, j / _tile_size);
+    return _matrix(i, j);
+  }
+
+  /**
+   * @brief      Overloading operator = for a assignment of a matrix or an
+   *             expression, which stamps every tile
+   */
+  template <typename R1> tracked_matrix &operator=(const R1 &other) {
+    if constexpr (std::is_same<R1, lazy_matrix<T, ploy>>::value) {
+      // a plain call would pick the deleted implicit copy assignment
+      _matrix.template operator=<R1>(other);
+    } else {
+      _matrix = other;
+    }
+    touch(0, 0, shape().first, shape().second);
+    return *this;
+  }
+  tracked_matrix &operator=(const tracked_matrix &other) {
+    return operator=(other._matrix);
+  }
+
+  /**
+   * @brief      Oveloading operator << to use std:: cout
+   */
+  friend std::ostream &operator<<(std::ostream &out,
+                                  const tracked_matrix &other) {
+    for (sz_t i = 0; i < other.shape().first; i++) {
+      for (sz_t j = 0; j < other.shape().second; j++) {
+        out << other(i, j) << ' ';
+      }
+      out << std::endl;
+    }
+    return out;
+  }
+};
+
+/**
+ * @brief      Copy of an expression tree that owns its nodes and refers to its
+ *             leaves, so that it outlives the statement building it
+ */
+template <typename R> class _kept {
+private:
+  const R &r;
+
+public:
+  _kept(const R &a) : r(a) {}
+  decltype(auto) shape() const { return r.shape(); }
+  decltype(auto) operator()(const sz_t &i, const sz_t &j) const {
+    return r(i, j);
+  }
+  const R &leaf() const { return r; }
+};
+template <typename R1, typename R2, typename Op> class _kept<expr<R1, R2, Op>> {
+private:
+  _kept<R1> op1;
+  _kept<R2> op2;
+  Op op;
+  std::pair<sz_t, sz_t> size;
+
+public:
+  _kept(const expr<R1, R2, Op> &e)
+      : op1(e.lhs()), op2(e.rhs()), op(e.functor()), size(e.shape()) {}
+  decltype(auto) shape() const { return size; }
+  decltype(auto) operator()(const sz_t &i, const sz_t &j) const {
+    return op(op1, op2, i, j);
+  }
+  const _kept<R1> &lhs() const { return op1; }
+  const _kept<R2> &rhs() const { return op2; }
+};
+
+template <typename E> class cached;
+
+/**
+ * @brief      Flags in mask the tiles of a leaf written after the clock read
+ *             since. Leaves that are not tracked are taken as constant.
+ */
+template <typename R>
+void _mark_dirty(const R &, const std::uint64_t &, _tile_mask &) {}
+template <typename T, typename ploy>
+void _mark_dirty(const tracked_matrix<T, ploy> &a, const std::uint64_t &since,
+                 _tile_mask &mask) {
+  for (sz_t ti = 0; ti < mask.rows; ti++) {
+    for (sz_t tj = 0; tj < mask.cols; tj++) {
+      mask(ti, tj) |= a.tile_epoch(ti, tj) > since;
+    }
+  }
+}
+template <typename E>
+void _mark_dirty(const cached<E> &a, const std::uint64_t &since,
+                 _tile_mask &mask) {
+  _mark_dirty(a.value(), since, mask);
+}
+template <typename R>
+void _mark_dirty(const _kept<R> &a, const std::uint64_t &since,
+                 _tile_mask &mask) {
+  _mark_dirty(a.leaf(), since, mask);
+}
+/**
+ * @brief      An element-wise node changes in the tiles where either operand
+ *             changed
+ */
+template <typename R1, typename R2, typename Op>
+void _mark_dirty(const _kept<expr<R1, R2, Op>> &a, const std::uint64_t &since,
+                 _tile_mask &mask) {
+  _mark_dirty(a.lhs(), since, mask);
+  _mark_dirty(a.rhs(), since, mask);
+}
+/**
+ * @brief      A product changes in the row bands where its left operand
+ *             changed and in the column bands where its right operand changed
+ */
+template <typename R1, typename R2>
+void _mark_dirty(const _kept<expr<R1, R2, _std_mul>> &a,
+                 const std::uint64_t &since, _tile_mask &mask) {
+  _tile_mask l(a.lhs().shape());
+  _tile_mask r(a.rhs().shape());
+  _mark_dirty(a.lhs(), since, l);
+  _mark_dirty(a.rhs(), since, r);
+  std::vector<char> rows(mask.rows, 0);
+  std::vector<char> cols(mask.cols, 0);
+  for (sz_t ti = 0; ti < l.rows; ti++) {
+    for (sz_t tk = 0; tk < l.cols; tk++) {
+      rows[ti] |= l(ti, tk);
+    }
+  }
+  for (sz_t tk = 0; tk < r.rows; tk++) {
+    for (sz_t tj = 0; tj < r.cols; tj++) {
+      cols[tj] |= r(tk, tj);
+    }
+  }
+  for (sz_t ti = 0; ti < mask.rows; ti++) {
+    for (sz_t tj = 0; tj < mask.cols; tj++) {
+      mask(ti, tj) |= rows[ti] | cols[tj];
+    }
+  }
+}
+
+/**
+ * @brief      Class for the materialized result of an expression that is
+ *             brought up to date incrementally.
+ *
+ *             update() recomputes only the tiles of the result that depend on
+ *             tiles of tracked operands written since the previous update:
+ *             the same tiles for element-wise operations, and the row and
+ *             column bands for %, so its cost follows the size of the change
+ *             rather than the size of the matrix. Operands that are not
+ *             tracked are assumed not to change between updates. The result
+ *             is itself tracked, so a cached expression can be an operand of
+ *             another one. The leaves of the expression must outlive it.
+ *
+ * @tparam     E     The expression type
+ */
+template <typename E> class cached : public expr_ops<cached<E>> {
+public:
+  using value_type = std::decay_t<decltype(std::declval<const E &>()(0, 0))>;
+
+private:
+  _kept<E> exp;
+  tracked_matrix<value_type> _result;
+  std::uint64_t since;
+  bool valid;
+
+public:
+  /**
+   * @brief      Constructs the object; the expression is evaluated by the
+   *             first update()
+   *
+   * @param[in]  e     The expression
+   */
+  cached(const E &e)
+      : exp(e), _result(e.shape().first, e.shape().second), since(0),
+        valid(false) {}
+
+  /**
+   * @brief      Recomputes the tiles of the result whose inputs changed, the
+   *             tiles being handed out dynamically to threads
+   *
+   * @return     The result
+   */
+  const tracked_matrix<value_type> &update() {
+    const std::uint64_t now = _epoch.fetch_add(1);
+    _tile_mask mask(shape());
+    if (valid) {
+      _mark_dirty(exp, since, mask);
+    } else {
+      std::fill(mask.bits.begin(), mask.bits.end(), 1);
+    }
+    std::vector<sz_t> dirty;
+    for (sz_t t = 0; t < mask.bits.size(); t++) {
+      if (mask.bits[t]) {
+        dirty.push_back(t);
+      }
+    }
+    const sz_t n = shape().first;
+    const sz_t m = shape().second;
+#pragma omp parallel for schedule(dynamic)
+    for (sz_t t = 0; t < dirty.size(); t++) {
+      const sz_t ti = dirty[t] / mask.cols * _tile_size;
+      const sz_t tj = dirty[t] % mask.cols * _tile_size;
+      for (sz_t i = ti; i < std::min(ti + _tile_size, n); i++) {
+        for (sz_t j = tj; j < std::min(tj + _tile_size, m); j++) {
+          _result(i, j) = exp(i, j);
+        }
+      }
+    }
+    since = now;
+    valid = true;
+    return _result;
+  }
+
+  /**
+   * @brief      Gives the dimensions of the result
+   */
+  decltype(auto) shape() const { return exp.shape(); }
+  /**
+   * @brief      Gives the result as of the last update()
+   */
+  const tracked_matrix<value_type> &value() const { return _result; }
+  /**
+   * Operator () Overloading for getting the (i,j)th element of the result
+   */
+  inline const value_type operator()(const sz_t i, const sz_t j) const {
+    return _result(i, j);
+  }
+};
+
+/**
+ * @brief      Makes a cached result of an expression
+ */
+template <typename E> cached<E> cache(const E &e) { return cached<E>(e); }
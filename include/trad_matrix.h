@@ -1,4 +1,5 @@
 #pragma once
+#include "numa.h"
 #include <cassert>
 #include <iostream>
 #include <type_traits>
@@ -15,7 +16,7 @@ using List = std::initializer_list<std::initializer_list<T>>;
  */
 template <typename T> class trad_matrix {
 private:
-  std::vector<T> _array;
+  std::vector<T, numa::allocator<T>> _array;
   sz_t size_x;
   sz_t size_y;
 
@@ -31,7 +32,7 @@ public:
    * @param[in]  m     Number of columns in the matrix
    */
   trad_matrix(const std::size_t &n, const std::size_t &m)
-      : _array(n * m), size_x(n), size_y(m) {}
+      : trad_matrix(n, m, T()) {}
   /**
    * @brief      Constructs the object.
    *
@@ -40,7 +41,15 @@ public:
    * @param[in]  val   The initial value
    */
   trad_matrix(const std::size_t &n, const std::size_t &m, const T &val)
-      : _array(n * m, val), size_x(n), size_y(m) {}
+      : _array(n * m), size_x(n), size_y(m) {
+    // parallel first touch so the pages are spread over the NUMA nodes
+#pragma omp parallel for schedule(static)
+    for (sz_t i = 0; i < size_x; i++) {
+      for (sz_t j = 0; j < size_y; j++) {
+        _array[i * size_y + j] = val;
+      }
+    }
+  }
   /**
    * @brief      Vector initialization
    *